@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <dictionaryreader.h>
+
+#include <cstring>			// memchr, memcpy, memcmp
+
+#include <algorithm>
+
+#include <statistics.h>
+
+using namespace std;
+
+namespace {
+
+const unsigned BUFFER_SIZE = 65536;
+
+const char HEX_PREFIX[] = "$HEX[";
+const size_t HEX_PREFIX_LENGTH = sizeof(HEX_PREFIX) - 1;
+
+const uint64_t ONES = 0x0101010101010101ULL;
+const uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+/**
+ * Set the highest bit of each byte greater than n, bytes must be below 0x80
+ */
+inline uint64_t greaterThan(uint64_t x, uint8_t n)
+{
+	return ((x + (0x7F - n) * ONES) & HIGH_BITS);
+}
+
+/**
+ * Decode 8 hexadecimal digits into 4 bytes at once (SWAR)
+ * @return False if any of the digits is not hexadecimal
+ */
+inline bool decodeHex8(const uint8_t *in, uint8_t *out)
+{
+	uint64_t x;
+	memcpy(&x, in, sizeof(x));
+
+	if (x & HIGH_BITS)
+		return (false);
+
+	// Digits already have the 0x20 bit, letters are folded to lower case
+	uint64_t folded = x | 0x20 * ONES;
+	uint64_t digit = greaterThan(x, '0' - 1) & ~greaterThan(x, '9');
+	uint64_t letter = greaterThan(folded, 'a' - 1) & ~greaterThan(folded, 'f');
+
+	if ((digit | letter) != HIGH_BITS)
+		return (false);
+
+	// '0'-'9' -> 0-9, 'a'-'f' (0x61-0x66) -> 1-6 + 9
+	uint64_t nibbles = (folded & 0x0F * ONES) + ((folded >> 6) & ONES) * 9;
+
+	// Join pairs of nibbles (the first one is the high nibble) and pack them
+	uint64_t bytes = ((nibbles & 0x00FF00FF00FF00FFULL) << 4)
+			| ((nibbles >> 8) & 0x00FF00FF00FF00FFULL);
+	bytes = (bytes | (bytes >> 8)) & 0x0000FFFF0000FFFFULL;
+	bytes = (bytes | (bytes >> 16)) & 0xFFFFFFFFULL;
+
+	uint32_t packed = static_cast<uint32_t>(bytes);
+	memcpy(out, &packed, sizeof(packed));
+
+	return (true);
+}
+
+inline int hexValue(uint8_t c)
+{
+	if (c >= '0' and c <= '9')
+		return (c - '0');
+
+	c |= 0x20;
+	if (c >= 'a' and c <= 'f')
+		return (c - 'a' + 10);
+
+	return (-1);
+}
+
+} // namespace
+
+bool ParseInputFormat(const std::string& name, InputFormat& format)
+{
+	if (name == "plain")
+		format = InputFormat::PLAIN;
+	else if (name == "hex")
+		format = InputFormat::HEX;
+	else if (name == "potfile")
+		format = InputFormat::POTFILE;
+	else if (name == "binary")
+		format = InputFormat::BINARY;
+	else
+		return (false);
+
+	return (true);
+}
+
+DictionaryReader::DictionaryReader(InputFormat format) :
+		_format { format }, _line_buffer(BUFFER_SIZE),
+		_decode_buffer(MAX_PASS_LENGTH)
+{
+}
+
+void DictionaryReader::Feed(const char* data, size_t length, Statistics& statistics)
+{
+	if (_format == InputFormat::BINARY)
+	{
+		feedRecords(data, length, statistics);
+		return;
+	}
+
+	const char *end = data + length;
+
+	while (data < end)
+	{
+		auto newline = static_cast<const char *>(memchr(data, '\n', end - data));
+
+		if (newline == nullptr)
+		{
+			appendLine(data, end - data);
+			break;
+		}
+
+		if (_line_length == 0)
+		{
+			// Whole line is in the chunk, avoid copying
+			addLine(data, newline - data, statistics);
+		}
+		else
+		{
+			appendLine(data, newline - data);
+			Flush(statistics);
+		}
+
+		data = newline + 1;
+	}
+}
+
+void DictionaryReader::Flush(Statistics& statistics)
+{
+	if (_format == InputFormat::BINARY)
+	{
+		// Record cut off by the end of input is dropped
+		_record_header = true;
+		_header_length = 0;
+		_line_length = 0;
+		return;
+	}
+
+	if (_line_length == 0)
+		return;
+
+	// Lines longer than the buffer are passed truncated, they are longer
+	// than any valid password anyway
+	size_t length = min<size_t>(_line_length, BUFFER_SIZE);
+	addLine(_line_buffer.data(), length, statistics);
+
+	_line_length = 0;
+}
+
+size_t DictionaryReader::CompleteLength(const char* data, size_t length) const
+{
+	if (_format == InputFormat::BINARY)
+	{
+		size_t complete = 0;
+
+		while (complete + 2 <= length)
+		{
+			size_t record = 2 + ((uint8_t(data[complete]) << 8) | uint8_t(data[complete + 1]));
+
+			if (complete + record > length)
+				break;
+
+			complete += record;
+		}
+
+		return (complete);
+	}
+
+	size_t complete = length;
+
+	while (complete > 0 and data[complete - 1] != '\n')
+		complete--;
+
+	return (complete);
+}
+
+const uint8_t* DictionaryReader::DecodeHex(const uint8_t* password,
+		size_t& length, uint8_t* decoded)
+{
+	if (length < HEX_PREFIX_LENGTH + 1 or password[length - 1] != ']'
+			or memcmp(password, HEX_PREFIX, HEX_PREFIX_LENGTH) != 0)
+		return (password);
+
+	const uint8_t *in = password + HEX_PREFIX_LENGTH;
+	size_t cnt_digits = length - HEX_PREFIX_LENGTH - 1;
+
+	// Longer passwords are invalid either way, lines in a chunk may be
+	// of any length
+	if (cnt_digits % 2 != 0 or cnt_digits / 2 > MAX_PASS_LENGTH)
+		return (password);
+
+	size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; i + 8 <= cnt_digits; i += 8)
+	{
+		if (not decodeHex8(in + i, decoded + i / 2))
+			return (password);
+	}
+#endif
+
+	for (; i < cnt_digits; i += 2)
+	{
+		int high = hexValue(in[i]);
+		int low = hexValue(in[i + 1]);
+
+		if (high < 0 or low < 0)
+			return (password);
+
+		decoded[i / 2] = (high << 4) | low;
+	}
+
+	length = cnt_digits / 2;
+	return (decoded);
+}
+
+void DictionaryReader::feedRecords(const char* data, size_t length,
+		Statistics& statistics)
+{
+	const char *end = data + length;
+
+	while (data < end)
+	{
+		if (_record_header)
+		{
+			_header[_header_length++] = *data++;
+
+			if (_header_length == sizeof(_header))
+			{
+				_record_remaining = (_header[0] << 8) | _header[1];
+				_record_header = false;
+				_header_length = 0;
+			}
+		}
+
+		if (_record_header)
+			continue;
+
+		size_t available = end - data;
+
+		if (_line_length == 0 and available >= _record_remaining)
+		{
+			// Whole record is in the chunk, avoid copying
+			addLine(data, _record_remaining, statistics);
+		}
+		else
+		{
+			size_t cnt_copy = min(available, _record_remaining);
+			appendLine(data, cnt_copy);
+			data += cnt_copy;
+			_record_remaining -= cnt_copy;
+
+			if (_record_remaining > 0)
+				break;
+
+			addLine(_line_buffer.data(), _line_length, statistics);
+			_line_length = 0;
+		}
+
+		data += _record_remaining;
+		_record_remaining = 0;
+		_record_header = true;
+	}
+}
+
+void DictionaryReader::appendLine(const char* data, size_t length)
+{
+	if (_line_length < BUFFER_SIZE)
+	{
+		size_t cnt_copy = min<size_t>(length, BUFFER_SIZE - _line_length);
+		memcpy(&_line_buffer[_line_length], data, cnt_copy);
+	}
+
+	_line_length += length;
+}
+
+void DictionaryReader::addLine(const char* line, size_t length,
+		Statistics& statistics)
+{
+	auto password = reinterpret_cast<const uint8_t *>(line);
+
+	switch (_format)
+	{
+		case InputFormat::POTFILE:
+		{
+			// Hashes may contain colons (salts), passwords from hashcat
+			// containing colons are written as $HEX[...]
+			size_t separator = length;
+			while (separator > 0 and password[separator - 1] != ':')
+				separator--;
+
+			if (separator == 0)
+			{
+				// Not a potfile line, counted as invalid
+				statistics.AddLine(password, 0);
+				return;
+			}
+
+			password += separator;
+			length -= separator;
+		}
+		// fall through
+		case InputFormat::HEX:
+			password = DecodeHex(password, length, _decode_buffer.data());
+			break;
+		default:
+			break;
+	}
+
+	statistics.AddLine(password, length);
+}
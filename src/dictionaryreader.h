@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_DICTIONARYREADER_H_
+#define SRC_DICTIONARYREADER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+class Statistics;
+
+/**
+ * Format of dictionary
+ */
+enum class InputFormat
+{
+	PLAIN,		///< one password per line
+	HEX,		///< one password per line, $HEX[...] is decoded
+	POTFILE,	///< hash:password per line (split at the last colon), $HEX[...] is decoded
+	BINARY		///< each password prefixed by its length (16 bits, big endian)
+};
+
+/**
+ * Parse name of input format (plain, hex, potfile, binary)
+ * @param name Name of format
+ * @param format Parsed format
+ * @return True if the name is known
+ */
+bool ParseInputFormat(const std::string &name, InputFormat &format);
+
+/**
+ * Split stream of bytes into lines and pass them into statistics.
+ * Parts of lines at the end of a chunk are kept until the next chunk,
+ * so arbitrary chunks may be fed without any allocation.
+ */
+class DictionaryReader
+{
+public:
+	DictionaryReader(InputFormat format = InputFormat::PLAIN);
+
+	/**
+	 * Pass all complete lines in chunk into statistics
+	 * @param data Chunk of dictionary
+	 * @param length Length of chunk in bytes
+	 * @param statistics Statistics to update
+	 */
+	void Feed(const char *data, size_t length, Statistics &statistics);
+
+	/**
+	 * Pass the last line without line feed into statistics
+	 * @param statistics Statistics to update
+	 */
+	void Flush(Statistics &statistics);
+
+	/**
+	 * Find end of the last complete line (or record) in data, so that data
+	 * may be split between readers without splitting lines
+	 * @param data Data starting at the beginning of a line
+	 * @param length Length of data in bytes
+	 * @return Length of complete lines, 0 if there is none
+	 */
+	size_t CompleteLength(const char *data, size_t length) const;
+
+	/**
+	 * Decode $HEX[...] password, other passwords and passwords longer than
+	 * MAX_PASS_LENGTH are left untouched
+	 * @param password Password
+	 * @param length Length of password, replaced by length of decoded password
+	 * @param decoded Buffer for at least MAX_PASS_LENGTH bytes
+	 * @return Pointer to decoded password or to the original one
+	 */
+	static const uint8_t *DecodeHex(const uint8_t *password, size_t &length,
+			uint8_t *decoded);
+
+private:
+	void feedRecords(const char *data, size_t length, Statistics &statistics);
+	void appendLine(const char *data, size_t length);
+
+	/**
+	 * Pass one line into statistics according to format
+	 */
+	void addLine(const char *line, size_t length, Statistics &statistics);
+
+	InputFormat _format;
+
+	std::vector<char> _line_buffer;
+	size_t _line_length = 0;
+
+	std::vector<uint8_t> _decode_buffer;
+
+	// Binary format: length of the record being read and its header
+	size_t _record_remaining = 0;
+	bool _record_header = true;
+	uint8_t _header[2];
+	unsigned _header_length = 0;
+};
+
+#endif /* SRC_DICTIONARYREADER_H_ */
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <kfoldstatistics.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>     // htons
+#endif
+
+#include <iostream>
+
+using namespace std;
+
+KFoldStatistics::KFoldStatistics(const Statistics& models, unsigned cnt_folds) :
+		_total { models.Clone() }, _cnt_fold_lines(cnt_folds)
+{
+	for (unsigned f = 0; f < cnt_folds; f++)
+		_folds.emplace_back(models.Clone());
+}
+
+KFoldStatistics::KFoldStatistics(const KFoldStatistics& other) :
+		Statistics(other), _total { other._total->Clone() },
+		_cnt_lines { other._cnt_lines }, _cnt_fold_lines(other._cnt_fold_lines)
+{
+	// Held-out lines are written only by the original
+	for (auto & fold : other._folds)
+		_folds.emplace_back(fold->Clone());
+}
+
+KFoldStatistics::~KFoldStatistics()
+{
+}
+
+void KFoldStatistics::AddLine(const uint8_t* line, unsigned length)
+{
+	// Number of the line is mixed in, otherwise all occurrences of a
+	// frequent password would fall into the same fold. High bits of the
+	// product select the fold, low bits of FNV-1a are poorly mixed.
+	uint64_t key = (HashPassword(line, length) ^ _cnt_lines++)
+			* UINT64_C(0x9E3779B97F4A7C15);
+	unsigned fold = ((key >> 32) * _folds.size()) >> 32;
+
+	_total->AddLine(line, length);
+	_folds[fold]->AddLine(line, length);
+	_cnt_fold_lines[fold]++;
+
+	if (_held_out.empty())
+		return;
+
+	// Binary passwords may contain line feeds, they are written as records
+	// of the input format
+	if (_input_format == InputFormat::BINARY)
+	{
+		uint16_t record_length = htons(length);
+		_held_out[fold]->write(reinterpret_cast<const char *>(&record_length),
+				sizeof(uint16_t));
+		_held_out[fold]->write(reinterpret_cast<const char *>(line), length);
+	}
+	else
+	{
+		_held_out[fold]->write(reinterpret_cast<const char *>(line), length);
+		_held_out[fold]->put('\n');
+	}
+}
+
+void KFoldStatistics::Write(std::ostream& output)
+{
+	_total->Write(output);
+}
+
+Statistics* KFoldStatistics::Clone() const
+{
+	return (new KFoldStatistics(*this));
+}
+
+void KFoldStatistics::Merge(const Statistics& other)
+{
+	auto & statistics = static_cast<const KFoldStatistics &>(other);
+
+	_total->Merge(*statistics._total);
+	_cnt_lines += statistics._cnt_lines;
+
+	for (size_t f = 0; f < _folds.size(); f++)
+	{
+		_folds[f]->Merge(*statistics._folds[f]);
+		_cnt_fold_lines[f] += statistics._cnt_fold_lines[f];
+	}
+}
+
+void KFoldStatistics::Subtract(const Statistics& other)
+{
+	auto & statistics = static_cast<const KFoldStatistics &>(other);
+
+	_total->Subtract(*statistics._total);
+	_cnt_lines -= statistics._cnt_lines;
+
+	for (size_t f = 0; f < _folds.size(); f++)
+	{
+		_folds[f]->Subtract(*statistics._folds[f]);
+		_cnt_fold_lines[f] -= statistics._cnt_fold_lines[f];
+	}
+}
+
+std::string KFoldStatistics::foldFile(const std::string& output_file, unsigned fold,
+		const std::string& extension)
+{
+	const string WSTAT_EXTENSION = ".wstat";
+	string base = output_file;
+
+	if (base.size() > WSTAT_EXTENSION.size()
+			and base.compare(base.size() - WSTAT_EXTENSION.size(),
+					WSTAT_EXTENSION.size(), WSTAT_EXTENSION) == 0)
+		base.resize(base.size() - WSTAT_EXTENSION.size());
+
+	return (base + ".fold" + to_string(fold + 1) + extension);
+}
+
+void KFoldStatistics::WriteHeldOut(const std::string& output_file)
+{
+	_held_out.clear();
+
+	for (unsigned f = 0; f < _folds.size(); f++)
+	{
+		_held_out.emplace_back(new ofstream { foldFile(output_file, f, ".txt"),
+				ofstream::out | ofstream::binary });
+	}
+}
+
+void KFoldStatistics::OutputFolds(const std::string& output_file,
+		const std::string& encoding, const std::string& description)
+{
+	// Held-out lines are complete once the models are written
+	for (auto & held_out : _held_out)
+		held_out->flush();
+
+	for (unsigned f = 0; f < _folds.size(); f++)
+	{
+		unique_ptr<Statistics> model { _total->Clone() };
+		model->Subtract(*_folds[f]);
+
+		ofstream output { foldFile(output_file, f, ".wstat"), ofstream::out
+				| ofstream::binary };
+
+		WriteFileHeader(output, encoding, description + " (without fold "
+				+ to_string(f + 1) + "/" + to_string(_folds.size()) + ")");
+		model->Write(output);
+	}
+}
+
+void KFoldStatistics::Summary()
+{
+	_total->Summary();
+
+	cout << "Folds for cross-validation: " << _folds.size() << "\n";
+
+	for (size_t f = 0; f < _folds.size(); f++)
+		cout << "\tFold " << f + 1 << ": " << _cnt_fold_lines[f] << " lines\n";
+}
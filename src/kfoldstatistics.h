@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_KFOLDSTATISTICS_H_
+#define SRC_KFOLDSTATISTICS_H_
+
+#include <fstream>
+#include <memory>
+
+#include <statistics.h>
+
+/**
+ * Build models for k-fold cross-validation in one pass. Each line is
+ * assigned to a fold by hash of the line and its number, so that
+ * occurrences of a frequent password are spread over all folds, and
+ * counted into the total and into its fold. The model leaving out a fold
+ * is the total minus the fold.
+ */
+class KFoldStatistics : public Statistics
+{
+public:
+	/**
+	 * @param models Configured models, total and folds are their copies
+	 * @param cnt_folds Number of folds (k)
+	 */
+	KFoldStatistics(const Statistics &models, unsigned cnt_folds);
+	KFoldStatistics(const KFoldStatistics &other);
+	virtual ~KFoldStatistics();
+
+	virtual void AddLine(const uint8_t *line, unsigned length);
+
+	/**
+	 * Write statistics of all lines
+	 */
+	virtual void Write(std::ostream &output);
+	virtual Statistics *Clone() const;
+	virtual void Merge(const Statistics &other);
+	virtual void Subtract(const Statistics &other);
+	virtual void Summary();
+
+	/**
+	 * Write lines of each fold into <base>.fold<N>.txt while counting,
+	 * passwords of binary input are written as binary records
+	 * @param output_file Output file, its .wstat extension is removed
+	 */
+	void WriteHeldOut(const std::string &output_file);
+
+	/**
+	 * Write model leaving out each fold into <base>.fold<N>.wstat
+	 * @param output_file Output file, its .wstat extension is removed
+	 * @param encoding Encoding written to file headers
+	 * @param description Description written to file headers
+	 */
+	void OutputFolds(const std::string &output_file, const std::string &encoding,
+			const std::string &description);
+
+private:
+	KFoldStatistics &operator=(const KFoldStatistics &) = delete;
+
+	static std::string foldFile(const std::string &output_file, unsigned fold,
+			const std::string &extension);
+
+	std::unique_ptr<Statistics> _total;
+	uint64_t _cnt_lines = 0;
+	std::vector<std::unique_ptr<Statistics>> _folds;
+	std::vector<uint64_t> _cnt_fold_lines;
+	std::vector<std::unique_ptr<std::ofstream>> _held_out;
+};
+
+#endif /* SRC_KFOLDSTATISTICS_H_ */
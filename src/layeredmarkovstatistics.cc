@@ -23,163 +23,154 @@
 
 #include <layeredmarkovstatistics.h>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#include <windows.h>
-#else
-#include <arpa/inet.h>     // ntohl, ntohs
-#endif
-
-#include <cstring>				// memset, strlen
+#include <sortedtransitions.h>
 
+#include <algorithm>		// stable_sort
 #include <iostream>
 
 using namespace std;
 
-namespace {
-
-const unsigned BUFFER_SIZE = 65536;
+LayeredMarkovStatistics::LayeredMarkovStatistics() :
+		_markov_stats(_CELLS)
+{
+}
 
-} // namespace
+LayeredMarkovStatistics::~LayeredMarkovStatistics()
+{
+}
 
-LayeredMarkovStatistics::LayeredMarkovStatistics()
+void LayeredMarkovStatistics::AddLine(const uint8_t* line, unsigned length)
 {
-	const int buffer_size = MAX_PASS_LENGTH * ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE;
+	const unsigned LAYER_SIZE = ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE;
+	uint8_t s0, s1;
 
-	_markov_stats_buffer = new uint64_t[buffer_size];
-	memset(_markov_stats_buffer, 0, buffer_size);
+	_cnt_total_lines++;
 
-	auto markov_tmp_ptr = _markov_stats_buffer;
+	if (length < MIN_PASS_LENGTH || length > MAX_PASS_LENGTH)
+		return;
 
-	for (int p = 0; p < MAX_PASS_LENGTH; p++)
-	{
-		for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
-		{
-			_markov_stats[p][i] = markov_tmp_ptr;
-			markov_tmp_ptr += ASCII_CHARSET_SIZE;
-		}
-	}
+	_cnt_valid_lines++;
 
-	_letter_frequencies = new StatEntry[ASCII_CHARSET_SIZE];
-	memset(_letter_frequencies, 0, ASCII_CHARSET_SIZE);
+	s1 = line[0];
+	_markov_stats[s1]++;
 
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
+	for (unsigned position = 0; position < (length - 1); position++)
 	{
-		_letter_frequencies[i].key = static_cast<uint8_t>(i);
-	}
+		s0 = line[position + 0];
+		s1 = line[position + 1];
 
-	_line_buffer = new char[BUFFER_SIZE];
+		_markov_stats[(position + 1) * LAYER_SIZE + s0 * ASCII_CHARSET_SIZE + s1]++;
+	}
 }
 
-LayeredMarkovStatistics::~LayeredMarkovStatistics()
+void LayeredMarkovStatistics::Write(std::ostream& output)
 {
-	delete[] _markov_stats_buffer;
-	delete[] _letter_frequencies;
-	delete[] _line_buffer;
-}
+	// Adjust a copy, so the statistics may be still updated
+	CountTable markov_stats { _markov_stats };
+	adjustProbabilities(markov_stats);
 
-void LayeredMarkovStatistics::CreateStatistics(const std::string& dictionary)
-{
-	ifstream input { dictionary, std::ifstream::in };
+	// Write type, total length in bytes and encoding at the beginning
+	_quantizer = Quantizer { _quantization };
+	writeSectionHeader(output, _TYPE, _CELLS * _quantizer.CellSize());
 
-	uint8_t s0, s1;
+	// Calc relative frequency and map it into the selected encoding
+	char row_buffer[ASCII_CHARSET_SIZE * sizeof(uint16_t)];
 
-	// Make frequency analysis of letters
-	while (input)
+	for (unsigned r = 0; r < MAX_PASS_LENGTH * ASCII_CHARSET_SIZE; r++)
 	{
-		input.getline(_line_buffer, BUFFER_SIZE);
-		_cnt_total_lines++;
+		_quantizer.QuantizeRow(&markov_stats[r * ASCII_CHARSET_SIZE],
+				ASCII_CHARSET_SIZE, row_buffer);
+		output.write(row_buffer, ASCII_CHARSET_SIZE * _quantizer.CellSize());
+	}
+
+	if (_sorted_transitions)
+	{
+		SortedTransitions sorted { _sorted_cutoff, _sorted_top };
+		sorted.Build(markov_stats.data(), MAX_PASS_LENGTH * ASCII_CHARSET_SIZE);
 
-		unsigned line_length = strlen(_line_buffer);
+		writeSectionHeader(output, _SORTED_TYPE, sorted.Length(), false);
+		sorted.Write(output);
+	}
+}
 
-		if (line_length < MIN_PASS_LENGTH || line_length > MAX_PASS_LENGTH)
-			continue;
+Statistics* LayeredMarkovStatistics::Clone() const
+{
+	return (new LayeredMarkovStatistics(*this));
+}
 
-		_cnt_valid_lines++;
+void LayeredMarkovStatistics::Merge(const Statistics& other)
+{
+	auto & statistics = static_cast<const LayeredMarkovStatistics &>(other);
 
-		s1 = _line_buffer[0];
-		_markov_stats[0][0][s1]++;
+	for (size_t i = 0; i < _markov_stats.size(); i++)
+		_markov_stats[i] += statistics._markov_stats[i];
 
-		for (int position = 0; position < (line_length - 1); position++)
-		{
-			s0 = _line_buffer[position + 0];
-			s1 = _line_buffer[position + 1];
+	_cnt_total_lines += statistics._cnt_total_lines;
+	_cnt_valid_lines += statistics._cnt_valid_lines;
+}
 
-			_letter_frequencies[s0].frequency++;
-			_markov_stats[position + 1][s0][s1]++;
-		}
+void LayeredMarkovStatistics::Subtract(const Statistics& other)
+{
+	auto & statistics = static_cast<const LayeredMarkovStatistics &>(other);
 
-		_letter_frequencies[s1].frequency++;
-	}
+	for (size_t i = 0; i < _markov_stats.size(); i++)
+		_markov_stats[i] -= statistics._markov_stats[i];
 
-	adjustProbabilities();
+	_cnt_total_lines -= statistics._cnt_total_lines;
+	_cnt_valid_lines -= statistics._cnt_valid_lines;
 }
 
-void LayeredMarkovStatistics::Output(const std::string& output_file)
+void LayeredMarkovStatistics::getLetterFrequencies(const CountTable &markov_stats,
+		unsigned* letter_frequencies)
 {
-	ofstream output { output_file, ofstream::out | ofstream::app
-			| ofstream::binary };
+	// Each letter is counted once in the table, either as the first letter
+	// of password or as the next letter of a transition, so frequency
+	// of letter is the sum of its column
+	uint64_t column_sums[ASCII_CHARSET_SIZE] = {};
+
+	for (unsigned r = 0; r < MAX_PASS_LENGTH * ASCII_CHARSET_SIZE; r++)
+	{
+		const uint64_t *row = &markov_stats[r * ASCII_CHARSET_SIZE];
 
-	// Write type at the beginning
-	output.write(reinterpret_cast<const char *>(&_TYPE), 1);
+		for (unsigned j = 0; j < ASCII_CHARSET_SIZE; j++)
+			column_sums[j] += row[j];
+	}
 
-	// Write total length in bytes
-	uint32_t length = htonl(_LENGTH);
-	output.write(reinterpret_cast<char *>(&length), sizeof(uint32_t));
+	StatEntry entries[ASCII_CHARSET_SIZE];
 
-	// Calc relative frequency and map it into 16 bit value
-	for (int p = 0; p < MAX_PASS_LENGTH; p++)
+	for (unsigned i = 0; i < ASCII_CHARSET_SIZE; i++)
 	{
-		for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
-		{
-			uint64_t total = 0;
-			for (int j = 0; j < ASCII_CHARSET_SIZE; j++)
-			{
-				total += _markov_stats[p][i][j];
-			}
-
-			for (int j = 0; j < ASCII_CHARSET_SIZE; j++)
-			{
-				double rel_probability = _markov_stats[p][i][j]
-						/ static_cast<double>(total);
-				uint16_t abs_probability = rel_probability * UINT16_MAX;
-
-				abs_probability = htons(abs_probability);
-
-				output.write(reinterpret_cast<char *>(&abs_probability),
-						sizeof(abs_probability));
-			}
-		}
+		entries[i].key = static_cast<uint8_t>(i);
+		entries[i].frequency = column_sums[i];
 	}
-}
 
-int LayeredMarkovStatistics::compareStatEntry(const void* p1, const void* p2)
-{
-	const StatEntry *e1 = static_cast<const StatEntry *>(p1);
-	const StatEntry *e2 = static_cast<const StatEntry *>(p2);
+	// Sort letter frequencies in descending order
+	stable_sort(entries, entries + ASCII_CHARSET_SIZE,
+			[](const StatEntry &e1, const StatEntry &e2)
+			{	return (e1.frequency > e2.frequency);});
 
-	return (e2->frequency - e1->frequency);
+	for (unsigned i = 0; i < ASCII_CHARSET_SIZE; i++)
+		letter_frequencies[entries[i].key] = (ASCII_CHARSET_SIZE - 1) - i;
 }
 
-void LayeredMarkovStatistics::adjustProbabilities()
+void LayeredMarkovStatistics::adjustProbabilities(CountTable &markov_stats)
 {
-	// Sort letter frequencies in descending order
-	qsort(_letter_frequencies, ASCII_CHARSET_SIZE, sizeof(StatEntry), compareStatEntry);
+	unsigned letter_frequencies[ASCII_CHARSET_SIZE];
+	getLetterFrequencies(markov_stats, letter_frequencies);
 
 	// Increase non zero Markov probabilities by charset size
 	// and increase zero probabilities by letter
 	// frequency (value from 0 to 255)
-	for (int p = 0; p < MAX_PASS_LENGTH; p++)
+	for (unsigned r = 0; r < MAX_PASS_LENGTH * ASCII_CHARSET_SIZE; r++)
 	{
-		for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
+		uint64_t *row = &markov_stats[r * ASCII_CHARSET_SIZE];
+
+		for (unsigned j = 0; j < ASCII_CHARSET_SIZE; j++)
 		{
-			for (int j = 0; j < ASCII_CHARSET_SIZE; j++)
-			{
-				if (_markov_stats[p][i][j] != 0)
-					_markov_stats[p][i][j] += ASCII_CHARSET_SIZE;
-				else
-					_markov_stats[p][i][j] += getLetterFrequency(j);
-			}
+			if (row[j] != 0)
+				row[j] += ASCII_CHARSET_SIZE;
+			else
+				row[j] += letter_frequencies[j];
 		}
 	}
 }
@@ -189,17 +180,10 @@ void LayeredMarkovStatistics::Summary()
 	cout << "Statistics for layered Markov model\n"
 			<< "\tTotal lines: " << _cnt_total_lines << "\n"
 			<< "\tValid lines: " << _cnt_valid_lines << "\n";
+	_quantizer.Summary();
 }
 
-unsigned LayeredMarkovStatistics::getLetterFrequency(uint8_t letter)
+bool LayeredMarkovStatistics::ParallelCounting() const
 {
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
-	{
-		if (_letter_frequencies[i].key == letter)
-		{
-			return ((ASCII_CHARSET_SIZE - 1) - i);
-		}
-	}
-
-	return (0);
+	return (true);
 }
@@ -25,6 +25,7 @@
 #define SRC_LAYEREDMARKOVSTATISTICS_H_
 
 #include <statistics.h>
+#include <tableallocator.h>
 
 /**
  * Create statistics for Layered Markov model
@@ -35,9 +36,13 @@ public:
 	LayeredMarkovStatistics();
 	virtual ~LayeredMarkovStatistics();
 
-	virtual void CreateStatistics(const std::string & dictionary);
-	virtual void Output(const std::string & output_file);
+	virtual void AddLine(const uint8_t *line, unsigned length);
+	virtual void Write(std::ostream &output);
+	virtual Statistics *Clone() const;
+	virtual void Merge(const Statistics &other);
+	virtual void Subtract(const Statistics &other);
 	virtual void Summary();
+	virtual bool ParallelCounting() const;
 
 private:
 	struct StatEntry
@@ -47,17 +52,14 @@ private:
 	};
 
 	const uint8_t _TYPE = 2;
-	const uint32_t _LENGTH = ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE * MAX_PASS_LENGTH
-			* sizeof(uint16_t);
+	const uint8_t _SORTED_TYPE = 4;
+	const uint32_t _CELLS = ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE * MAX_PASS_LENGTH;
 
-	static int compareStatEntry(const void *p1, const void *p2);
-	void adjustProbabilities();
-	unsigned getLetterFrequency(uint8_t letter);
+	void adjustProbabilities(CountTable &markov_stats);
+	void getLetterFrequencies(const CountTable &markov_stats,
+			unsigned *letter_frequencies);
 
-	uint64_t *_markov_stats_buffer;
-	uint64_t *_markov_stats[MAX_PASS_LENGTH][ASCII_CHARSET_SIZE];
-	StatEntry *_letter_frequencies;
-	char *_line_buffer;
+	CountTable _markov_stats;
 
 	uint64_t _cnt_valid_lines = 0;
 	uint64_t _cnt_total_lines = 0;
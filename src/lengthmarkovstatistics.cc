@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <lengthmarkovstatistics.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>     // htons
+#endif
+
+#include <algorithm>
+#include <functional>		// greater
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const unsigned CNT_CONTEXTS = (MAX_PASS_LENGTH * (MAX_PASS_LENGTH + 1) / 2)
+		* ASCII_CHARSET_SIZE;
+
+// 2 MB, one huge page
+const unsigned INITIAL_CAPACITY_BITS = 18;
+
+} // namespace
+
+LengthMarkovStatistics::LengthMarkovStatistics() :
+		_slots(size_t(1) << INITIAL_CAPACITY_BITS),
+		_capacity_bits { INITIAL_CAPACITY_BITS }
+{
+}
+
+LengthMarkovStatistics::~LengthMarkovStatistics()
+{
+}
+
+void LengthMarkovStatistics::AddLine(const uint8_t* line, unsigned length)
+{
+	_cnt_total_lines++;
+
+	if (length < MIN_PASS_LENGTH || length > MAX_PASS_LENGTH)
+		return;
+
+	_cnt_valid_lines++;
+
+	reserve(length);
+
+	uint64_t *slots = _slots.data();
+	unsigned capacity_bits = _capacity_bits;
+	uint32_t keys[MAX_PASS_LENGTH];
+	unsigned context = contextIndex(length, 0, 0);
+	uint8_t s0 = 0;
+	unsigned cnt_new_keys = 0;
+
+	// Slots of the whole line are loaded in parallel, before they are
+	// searched
+	for (unsigned position = 0; position < length; position++)
+	{
+		uint8_t s1 = line[position];
+
+		keys[position] = transitionKey(context + s0, s1);
+		__builtin_prefetch(slots + hash(keys[position], capacity_bits), 1);
+
+		context += ASCII_CHARSET_SIZE;
+		s0 = s1;
+	}
+
+	for (unsigned position = 0; position < length; position++)
+		cnt_new_keys += increment(slots, capacity_bits, keys[position], 1);
+
+	_cnt_keys += cnt_new_keys;
+}
+
+void LengthMarkovStatistics::grow(size_t cnt_keys)
+{
+	// At most 3/4 of slots are used
+	unsigned capacity_bits = _capacity_bits;
+
+	while (4 * (_cnt_keys + cnt_keys) > 3 * (size_t(1) << capacity_bits))
+		capacity_bits++;
+
+	CountTable slots { size_t(1) << capacity_bits };
+	_slots.swap(slots);
+	_capacity_bits = capacity_bits;
+
+	// Keys are unique, so they are only inserted, without comparing keys
+	uint64_t *new_slots = _slots.data();
+	size_t mask = _slots.size() - 1;
+
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		if (slots[i] == 0)
+			continue;
+
+		size_t j = hash(slots[i] >> COUNT_BITS, capacity_bits);
+
+		while (new_slots[j] != 0)
+			j = (j + 1) & mask;
+
+		new_slots[j] = slots[i];
+	}
+}
+
+uint64_t* LengthMarkovStatistics::find(uint32_t key)
+{
+	size_t mask = (size_t(1) << _capacity_bits) - 1;
+
+	for (size_t i = hash(key, _capacity_bits); _slots[i] != 0; i = (i + 1) & mask)
+	{
+		if (_slots[i] >> COUNT_BITS == key)
+			return (&_slots[i]);
+	}
+
+	return (nullptr);
+}
+
+void LengthMarkovStatistics::Write(std::ostream& output)
+{
+	// Rows are written as length, position and previous symbol (8 bits each),
+	// number of symbols (16 bits, big endian), symbols in descending order
+	// of probability and their quantized probabilities. Symbols which
+	// were not observed (or dropped to zero) are left out.
+	_quantizer = Quantizer { _quantization };
+
+	// Transitions are grouped by context, each as count and inverted symbol,
+	// so that descending order is by frequency and then by symbol
+	vector<uint32_t> first_transition(CNT_CONTEXTS + 1);
+
+	for (size_t i = 0; i < _slots.size(); i++)
+	{
+		if ((_slots[i] & COUNT_MASK) != 0)
+			first_transition[((_slots[i] >> COUNT_BITS) - 1) / ASCII_CHARSET_SIZE + 1]++;
+	}
+
+	for (unsigned context = 0; context < CNT_CONTEXTS; context++)
+		first_transition[context + 1] += first_transition[context];
+
+	vector<uint64_t> transitions(first_transition[CNT_CONTEXTS]);
+	vector<uint32_t> next_transition(first_transition.begin(), first_transition.end() - 1);
+
+	for (size_t i = 0; i < _slots.size(); i++)
+	{
+		uint64_t count = _slots[i] & COUNT_MASK;
+
+		if (count == 0)
+			continue;
+
+		uint32_t key = static_cast<uint32_t>((_slots[i] >> COUNT_BITS) - 1);
+		unsigned symbol = key % ASCII_CHARSET_SIZE;
+
+		transitions[next_transition[key / ASCII_CHARSET_SIZE]++] =
+				count << 8 | (ASCII_CHARSET_SIZE - 1 - symbol);
+	}
+
+	const unsigned ROW_HEADER_SIZE = 3 + sizeof(uint16_t);
+	uint64_t section_length = 0;
+
+	_cnt_transitions = transitions.size();
+	_cnt_rows = 0;
+
+	for (unsigned context = 0; context < CNT_CONTEXTS; context++)
+	{
+		unsigned cnt_symbols = first_transition[context + 1] - first_transition[context];
+
+		if (cnt_symbols == 0)
+			continue;
+
+		section_length += ROW_HEADER_SIZE + cnt_symbols * (1 + _quantizer.CellSize());
+		_cnt_rows++;
+	}
+
+	writeSectionHeader(output, _TYPE, static_cast<uint32_t>(section_length));
+
+	uint8_t symbols[ASCII_CHARSET_SIZE];
+	uint64_t frequencies[ASCII_CHARSET_SIZE];
+	char row_buffer[ASCII_CHARSET_SIZE * sizeof(uint16_t)];
+
+	for (unsigned length = MIN_PASS_LENGTH; length <= MAX_PASS_LENGTH; length++)
+	{
+		for (unsigned position = 0; position < length; position++)
+		{
+			for (unsigned s0 = 0; s0 < ASCII_CHARSET_SIZE; s0++)
+			{
+				unsigned context = contextIndex(length, position, s0);
+				auto begin = transitions.begin() + first_transition[context];
+				auto end = transitions.begin() + first_transition[context + 1];
+				unsigned cnt_symbols = end - begin;
+
+				if (cnt_symbols == 0)
+					continue;
+
+				sort(begin, end, greater<uint64_t>());
+
+				for (unsigned i = 0; i < cnt_symbols; i++)
+				{
+					symbols[i] = static_cast<uint8_t>(ASCII_CHARSET_SIZE - 1 - (begin[i] & 0xFF));
+					frequencies[i] = begin[i] >> 8;
+				}
+
+				uint8_t row_header[3] = { static_cast<uint8_t>(length),
+						static_cast<uint8_t>(position), static_cast<uint8_t>(s0) };
+				uint16_t row_length = htons(cnt_symbols);
+
+				output.write(reinterpret_cast<char *>(row_header), sizeof(row_header));
+				output.write(reinterpret_cast<char *>(&row_length), sizeof(uint16_t));
+				output.write(reinterpret_cast<char *>(symbols), cnt_symbols);
+
+				_quantizer.QuantizeRow(frequencies, cnt_symbols, row_buffer);
+				output.write(row_buffer, cnt_symbols * _quantizer.CellSize());
+			}
+		}
+	}
+}
+
+Statistics* LengthMarkovStatistics::Clone() const
+{
+	return (new LengthMarkovStatistics(*this));
+}
+
+void LengthMarkovStatistics::Merge(const Statistics& other)
+{
+	auto & statistics = static_cast<const LengthMarkovStatistics &>(other);
+	const CountTable &other_slots = statistics._slots;
+
+	// Slots of other table are in order of hash, so its new transitions
+	// would pile up in one cluster before the table grows. Space for them
+	// is made in advance, they are counted if they may not fit.
+	if (4 * (_cnt_keys + statistics._cnt_keys) > 3 * _slots.size())
+	{
+		size_t cnt_new_keys = 0;
+
+		for (size_t i = 0; i < other_slots.size(); i++)
+		{
+			if (other_slots[i] != 0 and find(other_slots[i] >> COUNT_BITS) == nullptr)
+				cnt_new_keys++;
+		}
+
+		reserve(cnt_new_keys);
+	}
+
+	uint64_t *slots = _slots.data();
+	unsigned capacity_bits = _capacity_bits;
+	size_t cnt_new_keys = 0;
+
+	for (size_t i = 0; i < other_slots.size(); i++)
+	{
+		if (other_slots[i] != 0)
+			cnt_new_keys += increment(slots, capacity_bits,
+					other_slots[i] >> COUNT_BITS, other_slots[i] & COUNT_MASK);
+	}
+
+	_cnt_keys += cnt_new_keys;
+
+	_cnt_total_lines += statistics._cnt_total_lines;
+	_cnt_valid_lines += statistics._cnt_valid_lines;
+}
+
+void LengthMarkovStatistics::Subtract(const Statistics& other)
+{
+	auto & statistics = static_cast<const LengthMarkovStatistics &>(other);
+	const CountTable &other_slots = statistics._slots;
+
+	// Other statistics were counted from a subset of lines, so transitions
+	// are always found. Transitions which drop to zero are skipped by Write().
+	for (size_t i = 0; i < other_slots.size(); i++)
+	{
+		if (other_slots[i] == 0)
+			continue;
+
+		uint64_t *slot = find(other_slots[i] >> COUNT_BITS);
+
+		if (slot != nullptr)
+			*slot -= other_slots[i] & COUNT_MASK;
+	}
+
+	_cnt_total_lines -= statistics._cnt_total_lines;
+	_cnt_valid_lines -= statistics._cnt_valid_lines;
+}
+
+void LengthMarkovStatistics::Summary()
+{
+	size_t bytes = _slots.size() * sizeof(uint64_t);
+
+	cout << "Statistics for length-conditioned layered Markov model\n"
+			<< "\tTotal lines: " << _cnt_total_lines << "\n"
+			<< "\tValid lines: " << _cnt_valid_lines << "\n"
+			<< "\tTransitions: " << _cnt_transitions << " in " << _cnt_rows
+			<< " contexts (" << bytes / 1024 << " kB)\n";
+	_quantizer.Summary();
+}
+
+bool LengthMarkovStatistics::ParallelCounting() const
+{
+	return (true);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_LENGTHMARKOVSTATISTICS_H_
+#define SRC_LENGTHMARKOVSTATISTICS_H_
+
+#include <statistics.h>
+#include <tableallocator.h>
+
+/**
+ * Create statistics for Layered Markov model conditioned on password length.
+ * Transitions are keyed by (length, position, previous symbol, symbol). The
+ * dense table would take 50x more memory than the layered one, so counts
+ * are kept in an open addressing table keyed by the whole transition, key
+ * and count share one 8 byte slot. Memory, merging and writing are
+ * proportional to the number of observed transitions. Only observed
+ * transitions are written, as sparse rows.
+ */
+class LengthMarkovStatistics : public Statistics
+{
+public:
+	LengthMarkovStatistics();
+	virtual ~LengthMarkovStatistics();
+
+	virtual void AddLine(const uint8_t *line, unsigned length);
+	virtual void Write(std::ostream &output);
+	virtual Statistics *Clone() const;
+	virtual void Merge(const Statistics &other);
+	virtual void Subtract(const Statistics &other);
+	virtual void Summary();
+	virtual bool ParallelCounting() const;
+
+private:
+	// Slot holds key of transition (27 bits) and its count (37 bits), 0 if empty
+	static const unsigned COUNT_BITS = 37;
+	static const uint64_t COUNT_MASK = (UINT64_C(1) << COUNT_BITS) - 1;
+
+	const uint8_t _TYPE = 5;
+
+	/**
+	 * Index of context, contexts are ordered by length, position
+	 * and previous symbol
+	 */
+	static unsigned contextIndex(unsigned length, unsigned position, uint8_t s0)
+	{
+		return (((length - 1) * length / 2 + position) * ASCII_CHARSET_SIZE + s0);
+	}
+
+	/**
+	 * Non-zero key of transition from context to symbol s1
+	 */
+	static uint32_t transitionKey(unsigned context, uint8_t s1)
+	{
+		return (context * ASCII_CHARSET_SIZE + s1 + 1);
+	}
+
+	static size_t hash(uint32_t key, unsigned capacity_bits)
+	{
+		// Fibonacci hashing
+		return ((key * UINT32_C(2654435769)) >> (32 - capacity_bits));
+	}
+
+	/**
+	 * Add count to transition, there must be space for a new transition
+	 * (see reserve()). Members are passed as values, stores to slots
+	 * would force them to be reloaded.
+	 * @return 1 if the transition is new, 0 otherwise
+	 */
+	static unsigned increment(uint64_t *slots, unsigned capacity_bits,
+			uint32_t key, uint64_t count)
+	{
+		size_t mask = (size_t(1) << capacity_bits) - 1;
+
+		for (size_t i = hash(key, capacity_bits);; i = (i + 1) & mask)
+		{
+			if (slots[i] >> COUNT_BITS == key)
+			{
+				slots[i] += count;
+				return (0);
+			}
+
+			if (slots[i] == 0)
+			{
+				slots[i] = uint64_t(key) << COUNT_BITS | count;
+				return (1);
+			}
+		}
+	}
+
+	/**
+	 * Make space for cnt_keys new transitions
+	 */
+	void reserve(size_t cnt_keys)
+	{
+		if (4 * (_cnt_keys + cnt_keys) > 3 * _slots.size())
+			grow(cnt_keys);
+	}
+
+	void grow(size_t cnt_keys);
+
+	/**
+	 * Find slot of transition
+	 * @return Slot or nullptr if the transition wasn't observed
+	 */
+	uint64_t *find(uint32_t key);
+
+	CountTable _slots;
+	unsigned _capacity_bits;
+	size_t _cnt_keys = 0;
+
+	uint64_t _cnt_valid_lines = 0;
+	uint64_t _cnt_total_lines = 0;
+	uint64_t _cnt_rows = 0;
+	uint64_t _cnt_transitions = 0;
+};
+
+#endif /* SRC_LENGTHMARKOVSTATISTICS_H_ */
@@ -23,170 +23,155 @@
 
 #include <markovstatistics.h>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#include <windows.h>
-#else
-#include <arpa/inet.h>     // ntohl, ntohs
-#endif
-
-#include <cstring>			// memset, strlen
+#include <sortedtransitions.h>
 
+#include <algorithm>		// stable_sort
 #include <iostream>
 
 using namespace std;
 
-namespace {
-
-const unsigned BUFFER_SIZE = 65536;
-
-} // namespace
-
-int MarkovStatistics::compareStatEntry(const void *p1, const void *p2)
+MarkovStatistics::MarkovStatistics() :
+		_markov_stats(_CELLS)
 {
-	const StatEntry *e1 = static_cast<const StatEntry *>(p1);
-	const StatEntry *e2 = static_cast<const StatEntry *>(p2);
+}
 
-	return (e2->frequency - e1->frequency);
+MarkovStatistics::~MarkovStatistics()
+{
 }
 
-MarkovStatistics::MarkovStatistics()
+void MarkovStatistics::AddLine(const uint8_t* line, unsigned length)
 {
-	const int buffer_size = ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE;
+	uint8_t s0, s1;
 
-	_markov_stats_buffer = new uint64_t[buffer_size];
-	memset(_markov_stats_buffer, 0, buffer_size);
+	_cnt_total_lines++;
 
-	auto markov_tmp_ptr = _markov_stats_buffer;
+	if (length < MIN_PASS_LENGTH || length > MAX_PASS_LENGTH)
+		return;
 
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
-	{
-		_markov_stats[i] = markov_tmp_ptr;
-		markov_tmp_ptr += ASCII_CHARSET_SIZE;
-	}
+	_cnt_valid_lines++;
 
-	_letter_frequencies = new StatEntry[ASCII_CHARSET_SIZE];
-	memset(_letter_frequencies, 0, ASCII_CHARSET_SIZE);
+	s1 = line[0];
+	_markov_stats[s1]++;
 
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
+	for (unsigned position = 0; position < (length - 1); position++)
 	{
-		_letter_frequencies[i].key = static_cast<uint8_t>(i);
-	}
-
-	_line_buffer = new char[BUFFER_SIZE];
-}
+		s0 = line[position + 0];
+		s1 = line[position + 1];
 
-MarkovStatistics::~MarkovStatistics()
-{
-	delete[] _markov_stats_buffer;
-	delete[] _letter_frequencies;
-	delete[] _line_buffer;
+		_markov_stats[s0 * ASCII_CHARSET_SIZE + s1]++;
+	}
 }
 
-void MarkovStatistics::CreateStatistics(const std::string & dictionary)
+void MarkovStatistics::getLetterFrequencies(const CountTable &markov_stats,
+		unsigned* letter_frequencies)
 {
-	ifstream input { dictionary, std::ifstream::in };
+	// Each letter is counted once in the table, either as the first letter
+	// of password or as the next letter of a transition, so frequency
+	// of letter is the sum of its column
+	uint64_t column_sums[ASCII_CHARSET_SIZE] = {};
 
-	uint8_t s0, s1;
-
-	// Make frequency analysis of letters
-	while (input)
+	for (unsigned r = 0; r < ASCII_CHARSET_SIZE; r++)
 	{
-		input.getline(_line_buffer, BUFFER_SIZE);
-		_cnt_total_lines++;
-
-		unsigned line_length = strlen(_line_buffer);
-
-		if (line_length < MIN_PASS_LENGTH || line_length > MAX_PASS_LENGTH)
-			continue;
+		const uint64_t *row = &markov_stats[r * ASCII_CHARSET_SIZE];
 
-		_cnt_valid_lines++;
-
-		s1 = _line_buffer[0];
-		_markov_stats[0][s1]++;
-
-		for (int position = 0; position < (line_length - 1); position++)
-		{
-			s0 = _line_buffer[position + 0];
-			s1 = _line_buffer[position + 1];
-
-			_letter_frequencies[s0].frequency++;
-			_markov_stats[s0][s1]++;
-		}
+		for (unsigned j = 0; j < ASCII_CHARSET_SIZE; j++)
+			column_sums[j] += row[j];
+	}
 
-		_letter_frequencies[s1].frequency++;
+	StatEntry entries[ASCII_CHARSET_SIZE];
 
+	for (unsigned i = 0; i < ASCII_CHARSET_SIZE; i++)
+	{
+		entries[i].key = static_cast<uint8_t>(i);
+		entries[i].frequency = column_sums[i];
 	}
 
-	adjustProbabilities();
+	// Sort letter frequencies in descending order
+	stable_sort(entries, entries + ASCII_CHARSET_SIZE,
+			[](const StatEntry &e1, const StatEntry &e2)
+			{	return (e1.frequency > e2.frequency);});
 
+	for (unsigned i = 0; i < ASCII_CHARSET_SIZE; i++)
+		letter_frequencies[entries[i].key] = (ASCII_CHARSET_SIZE - 1) - i;
 }
 
-void MarkovStatistics::adjustProbabilities()
+void MarkovStatistics::adjustProbabilities(CountTable &markov_stats)
 {
-	// Sort letter frequencies in descending order
-	qsort(_letter_frequencies, ASCII_CHARSET_SIZE, sizeof(StatEntry), compareStatEntry);
+	unsigned letter_frequencies[ASCII_CHARSET_SIZE];
+	getLetterFrequencies(markov_stats, letter_frequencies);
 
 	// Increase non zero Markov probabilities by charset size
 	// and increase zero probabilities by letter
 	// frequency (value from 0 to 255)
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
+	for (unsigned i = 0; i < ASCII_CHARSET_SIZE; i++)
 	{
-		for (int j = 0; j < ASCII_CHARSET_SIZE; j++)
+		uint64_t *row = &markov_stats[i * ASCII_CHARSET_SIZE];
+
+		for (unsigned j = 0; j < ASCII_CHARSET_SIZE; j++)
 		{
-			if (_markov_stats[i][j] != 0)
-				_markov_stats[i][j] += ASCII_CHARSET_SIZE;
+			if (row[j] != 0)
+				row[j] += ASCII_CHARSET_SIZE;
 			else
-				_markov_stats[i][j] += getLetterFrequency(j);
+				row[j] += letter_frequencies[j];
 		}
 	}
 }
 
-unsigned MarkovStatistics::getLetterFrequency(uint8_t letter)
+void MarkovStatistics::Write(std::ostream& output)
 {
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
+	// Adjust a copy, so the statistics may be still updated
+	CountTable markov_stats { _markov_stats };
+	adjustProbabilities(markov_stats);
+
+	// Write type, total length in bytes and encoding at the beginning
+	_quantizer = Quantizer { _quantization };
+	writeSectionHeader(output, _TYPE, _CELLS * _quantizer.CellSize());
+
+	// Calc relative frequency and map it into the selected encoding
+	char row_buffer[ASCII_CHARSET_SIZE * sizeof(uint16_t)];
+
+	for (unsigned i = 0; i < ASCII_CHARSET_SIZE; i++)
 	{
-		if (_letter_frequencies[i].key == letter)
-		{
-			return ((ASCII_CHARSET_SIZE - 1) - i);
-		}
+		_quantizer.QuantizeRow(&markov_stats[i * ASCII_CHARSET_SIZE],
+				ASCII_CHARSET_SIZE, row_buffer);
+		output.write(row_buffer, ASCII_CHARSET_SIZE * _quantizer.CellSize());
 	}
 
-	return (0);
+	if (_sorted_transitions)
+	{
+		SortedTransitions sorted { _sorted_cutoff, _sorted_top };
+		sorted.Build(markov_stats.data(), ASCII_CHARSET_SIZE);
+
+		writeSectionHeader(output, _SORTED_TYPE, sorted.Length(), false);
+		sorted.Write(output);
+	}
 }
 
-void MarkovStatistics::Output(const std::string& output_file)
+Statistics* MarkovStatistics::Clone() const
 {
-	ofstream output { output_file, ofstream::out | ofstream::app
-			| ofstream::binary };
+	return (new MarkovStatistics(*this));
+}
 
-	// Write type at the beginning
-	output.write(reinterpret_cast<const char *>(&_TYPE), 1);
+void MarkovStatistics::Merge(const Statistics& other)
+{
+	auto & statistics = static_cast<const MarkovStatistics &>(other);
 
-	// Write total length in bytes
-	uint32_t length = htonl(_LENGTH);
-	output.write(reinterpret_cast<char *>(&length), sizeof(uint32_t));
+	for (size_t i = 0; i < _markov_stats.size(); i++)
+		_markov_stats[i] += statistics._markov_stats[i];
 
-	for (int i = 0; i < ASCII_CHARSET_SIZE; i++)
-	{
-		uint64_t total = 0;
-		for (int j = 0; j < ASCII_CHARSET_SIZE; j++)
-		{
-			total += _markov_stats[i][j];
-		}
+	_cnt_total_lines += statistics._cnt_total_lines;
+	_cnt_valid_lines += statistics._cnt_valid_lines;
+}
 
-		for (int j = 0; j < ASCII_CHARSET_SIZE; j++)
-		{
-			double rel_probability = _markov_stats[i][j] / static_cast<double>(total);
-			uint16_t abs_probability = rel_probability * UINT16_MAX;
+void MarkovStatistics::Subtract(const Statistics& other)
+{
+	auto & statistics = static_cast<const MarkovStatistics &>(other);
 
-			// Convert to big endian
-			abs_probability = htons(abs_probability);
+	for (size_t i = 0; i < _markov_stats.size(); i++)
+		_markov_stats[i] -= statistics._markov_stats[i];
 
-			output.write(reinterpret_cast<char *>(&abs_probability),
-					sizeof(abs_probability));
-		}
-	}
+	_cnt_total_lines -= statistics._cnt_total_lines;
+	_cnt_valid_lines -= statistics._cnt_valid_lines;
 }
 
 void MarkovStatistics::Summary()
@@ -194,4 +179,10 @@ void MarkovStatistics::Summary()
 	cout << "Statistics for first-order Markov model\n"
 			<< "\tTotal lines: " << _cnt_total_lines << "\n"
 			<< "\tValid lines: " << _cnt_valid_lines << "\n";
+	_quantizer.Summary();
+}
+
+bool MarkovStatistics::ParallelCounting() const
+{
+	return (true);
 }
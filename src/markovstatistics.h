@@ -25,6 +25,7 @@
 #define SRC_MARKOVSTATISTICS_H_
 
 #include <statistics.h>
+#include <tableallocator.h>
 
 /**
  * Create statistics for 1st order Markov model
@@ -35,9 +36,13 @@ public:
 	MarkovStatistics();
 	virtual ~MarkovStatistics();
 
-	virtual void CreateStatistics(const std::string & dictionary);
-	virtual void Output(const std::string & output_file);
+	virtual void AddLine(const uint8_t *line, unsigned length);
+	virtual void Write(std::ostream &output);
+	virtual Statistics *Clone() const;
+	virtual void Merge(const Statistics &other);
+	virtual void Subtract(const Statistics &other);
 	virtual void Summary();
+	virtual bool ParallelCounting() const;
 
 private:
 	struct StatEntry
@@ -47,32 +52,24 @@ private:
 	};
 
 	const uint8_t _TYPE = 1;
-	const uint32_t _LENGTH = ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE * sizeof(uint16_t);
-
-	/**
-	 * Compare two stat entries
-	 * @return <0 if first entry is bigger than second
-	 * 0 if entries are equal
-	 * >0 otherwise
-	 */
-	static int compareStatEntry(const void *p1, const void *p2);
+	const uint8_t _SORTED_TYPE = 3;
+	const uint32_t _CELLS = ASCII_CHARSET_SIZE * ASCII_CHARSET_SIZE;
 
 	/**
 	 * Adjust zero Markov probabilities based on letter frequencies in dictionary
+	 * @param markov_stats Copy of Markov statistics to adjust
 	 */
-	void adjustProbabilities();
+	void adjustProbabilities(CountTable &markov_stats);
 
 	/**
-	 * Get frequency of letter in dictionary
-	 * @param letter 8bit value of letter
-	 * @return Letter frequency in the range of 0 (lowest) to 255 (highest)
+	 * Get frequencies of letters in dictionary
+	 * @param letter_frequencies Letter frequency in the range of 0 (lowest)
+	 * to 255 (highest) for each letter
 	 */
-	unsigned getLetterFrequency(uint8_t letter);
+	void getLetterFrequencies(const CountTable &markov_stats,
+			unsigned *letter_frequencies);
 
-	uint64_t *_markov_stats_buffer;
-	uint64_t *_markov_stats[ASCII_CHARSET_SIZE];
-	StatEntry *_letter_frequencies;
-	char *_line_buffer;
+	CountTable _markov_stats;
 	uint64_t _cnt_valid_lines = 0;
 	uint64_t _cnt_total_lines = 0;
 };
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <quantization.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>     // htons
+#endif
+
+#include <algorithm>		// min, max
+#include <cmath>
+#include <cstring>			// memcpy
+
+#include <iostream>
+
+#include <statistics.h>
+
+using namespace std;
+
+namespace {
+
+// Both logarithmic encodings cover probabilities down to 2^-32
+const double LOG_16_STEPS = 2048.0;
+const double LOG_8_STEPS = 8.0;
+
+/**
+ * Compute relative probabilities of one row
+ */
+void relativeKernel(const uint64_t *frequencies, unsigned size, double *probabilities)
+{
+	uint64_t total = 0;
+	for (unsigned j = 0; j < size; j++)
+		total += frequencies[j];
+
+	const double total_d = (total != 0) ? static_cast<double>(total) : 1.0;
+	for (unsigned j = 0; j < size; j++)
+		probabilities[j] = frequencies[j] / total_d;
+}
+
+void linearKernel(const double *probabilities, unsigned size, uint16_t *codes,
+		double *decoded)
+{
+	for (unsigned j = 0; j < size; j++)
+		codes[j] = probabilities[j] * UINT16_MAX;
+
+	for (unsigned j = 0; j < size; j++)
+		decoded[j] = codes[j] / static_cast<double>(UINT16_MAX);
+}
+
+template<typename T>
+void logKernel(const double *probabilities, unsigned size, double steps, T *codes,
+		double *decoded)
+{
+	const double max_code = static_cast<double>(static_cast<T>(~T(0)));
+	double scaled[ASCII_CHARSET_SIZE];
+
+	for (unsigned j = 0; j < size; j++)
+		scaled[j] = -std::log2(probabilities[j]) * steps;
+
+	for (unsigned j = 0; j < size; j++)
+		codes[j] = static_cast<T>(std::min(std::nearbyint(scaled[j]), max_code));
+
+	for (unsigned j = 0; j < size; j++)
+		decoded[j] = std::exp2(-codes[j] / steps);
+}
+
+} // namespace
+
+bool ParseQuantization(const std::string& name, Quantization& encoding)
+{
+	if (name == "linear16")
+		encoding = Quantization::LINEAR_16;
+	else if (name == "log16")
+		encoding = Quantization::LOG_16;
+	else if (name == "log8")
+		encoding = Quantization::LOG_8;
+	else
+		return (false);
+
+	return (true);
+}
+
+const char *QuantizationName(Quantization encoding)
+{
+	switch (encoding)
+	{
+		case Quantization::LOG_16:
+			return ("log16");
+		case Quantization::LOG_8:
+			return ("log8");
+		default:
+			return ("linear16");
+	}
+}
+
+Quantizer::Quantizer(Quantization encoding) :
+		_encoding { encoding }
+{
+}
+
+unsigned Quantizer::CellSize() const
+{
+	return ((_encoding == Quantization::LOG_8) ? sizeof(uint8_t) : sizeof(uint16_t));
+}
+
+void Quantizer::QuantizeRow(const uint64_t* frequencies, unsigned size, char* output)
+{
+	double probabilities[ASCII_CHARSET_SIZE];
+	double decoded[ASCII_CHARSET_SIZE];
+	uint16_t codes16[ASCII_CHARSET_SIZE];
+	uint8_t codes8[ASCII_CHARSET_SIZE];
+
+	relativeKernel(frequencies, size, probabilities);
+
+	switch (_encoding)
+	{
+		case Quantization::LINEAR_16:
+			linearKernel(probabilities, size, codes16, decoded);
+			break;
+		case Quantization::LOG_16:
+			logKernel(probabilities, size, LOG_16_STEPS, codes16, decoded);
+			break;
+		case Quantization::LOG_8:
+			logKernel(probabilities, size, LOG_8_STEPS, codes8, decoded);
+			break;
+	}
+
+	// Convert to big endian
+	if (_encoding == Quantization::LOG_8)
+	{
+		memcpy(output, codes8, size);
+	}
+	else
+	{
+		for (unsigned j = 0; j < size; j++)
+			codes16[j] = htons(codes16[j]);
+
+		memcpy(output, codes16, size * sizeof(uint16_t));
+	}
+
+	for (unsigned j = 0; j < size; j++)
+	{
+		double abs_error = std::fabs(decoded[j] - probabilities[j]);
+
+		_sum_abs_error += abs_error;
+		_max_abs_error = std::max(_max_abs_error, abs_error);
+
+		if (probabilities[j] > 0.0)
+			_max_rel_error = std::max(_max_rel_error, abs_error / probabilities[j]);
+	}
+
+	_cnt_cells += size;
+}
+
+void Quantizer::Summary() const
+{
+	double mean_abs_error = (_cnt_cells != 0) ? _sum_abs_error / _cnt_cells : 0.0;
+
+	cout << "\tQuantization: " << QuantizationName(_encoding) << "\n"
+			<< "\t\tMean absolute error: " << mean_abs_error << "\n"
+			<< "\t\tMax absolute error: " << _max_abs_error << "\n"
+			<< "\t\tMax relative error: " << _max_rel_error << "\n";
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_QUANTIZATION_H_
+#define SRC_QUANTIZATION_H_
+
+#include <cstdint>
+
+#include <string>
+
+/**
+ * Encoding of relative probabilities in output tables
+ */
+enum class Quantization : uint8_t
+{
+	LINEAR_16 = 0,	///< p * UINT16_MAX, the original encoding
+	LOG_16 = 1,		///< -log2(p) in 1/2048 steps, saturated at UINT16_MAX
+	LOG_8 = 2		///< -log2(p) in 1/8 steps, saturated at UINT8_MAX
+};
+
+/**
+ * Parse name of encoding (linear16, log16, log8)
+ * @param name Name of encoding
+ * @param encoding Parsed encoding
+ * @return True if the name is known
+ */
+bool ParseQuantization(const std::string &name, Quantization &encoding);
+
+/**
+ * Get name of encoding
+ */
+const char *QuantizationName(Quantization encoding);
+
+/**
+ * Quantize rows of frequency tables and keep track of the quantization error
+ */
+class Quantizer
+{
+public:
+	Quantizer(Quantization encoding = Quantization::LINEAR_16);
+
+	/**
+	 * Size of one quantized cell in bytes
+	 */
+	unsigned CellSize() const;
+
+	/**
+	 * Convert one row of frequencies into quantized big endian probabilities
+	 * @param frequencies Row of frequencies
+	 * @param size Number of cells in the row (at most ASCII_CHARSET_SIZE)
+	 * @param output Buffer for size * CellSize() bytes
+	 */
+	void QuantizeRow(const uint64_t *frequencies, unsigned size, char *output);
+
+	/**
+	 * Print encoding and quantization error of all rows quantized so far
+	 */
+	void Summary() const;
+
+private:
+	Quantization _encoding;
+
+	double _sum_abs_error = 0.0;
+	double _max_abs_error = 0.0;
+	double _max_rel_error = 0.0;
+	uint64_t _cnt_cells = 0;
+};
+
+#endif /* SRC_QUANTIZATION_H_ */
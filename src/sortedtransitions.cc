@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <sortedtransitions.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>     // htons
+#endif
+
+#include <algorithm>
+#include <thread>
+
+#include <statistics.h>
+
+using namespace std;
+
+SortedTransitions::SortedTransitions(double cutoff, unsigned top) :
+		_cutoff { cutoff }, _top { min(top, ASCII_CHARSET_SIZE) }
+{
+}
+
+void SortedTransitions::Build(const uint64_t* table, unsigned cnt_rows)
+{
+	_row_lengths.assign(cnt_rows, 0);
+	_symbols.assign(cnt_rows * ASCII_CHARSET_SIZE, 0);
+
+	unsigned cnt_threads = max(1u, thread::hardware_concurrency());
+	cnt_threads = min(cnt_threads, cnt_rows);
+
+	if (cnt_threads <= 1)
+	{
+		sortRows(table, 0, cnt_rows);
+		return;
+	}
+
+	vector<thread> threads;
+	unsigned rows_per_thread = (cnt_rows + cnt_threads - 1) / cnt_threads;
+
+	for (unsigned first = 0; first < cnt_rows; first += rows_per_thread)
+	{
+		unsigned last = min(first + rows_per_thread, cnt_rows);
+		threads.emplace_back(&SortedTransitions::sortRows, this, table, first, last);
+	}
+
+	for (auto & t : threads)
+		t.join();
+}
+
+void SortedTransitions::sortRows(const uint64_t* table, unsigned first,
+		unsigned last)
+{
+	for (unsigned r = first; r < last; r++)
+	{
+		const uint64_t *row = &table[r * ASCII_CHARSET_SIZE];
+		uint8_t *symbols = &_symbols[r * ASCII_CHARSET_SIZE];
+		uint64_t total = 0;
+
+		for (unsigned j = 0; j < ASCII_CHARSET_SIZE; j++)
+		{
+			symbols[j] = static_cast<uint8_t>(j);
+			total += row[j];
+		}
+
+		// Descending probability, lower symbol first on ties
+		stable_sort(symbols, symbols + ASCII_CHARSET_SIZE,
+				[row](uint8_t a, uint8_t b) { return (row[a] > row[b]); });
+
+		uint64_t cumulative = 0;
+		unsigned length = 0;
+
+		while (length < _top and row[symbols[length]] != 0
+				and cumulative < _cutoff * total)
+		{
+			cumulative += row[symbols[length]];
+			length++;
+		}
+
+		_row_lengths[r] = length;
+	}
+}
+
+uint32_t SortedTransitions::Length() const
+{
+	uint32_t length = _row_lengths.size() * sizeof(uint16_t);
+
+	for (auto l : _row_lengths)
+		length += l;
+
+	return (length);
+}
+
+void SortedTransitions::Write(std::ostream& output) const
+{
+	for (size_t r = 0; r < _row_lengths.size(); r++)
+	{
+		uint16_t length = htons(_row_lengths[r]);
+		output.write(reinterpret_cast<char *>(&length), sizeof(uint16_t));
+		output.write(reinterpret_cast<const char *>(&_symbols[r * ASCII_CHARSET_SIZE]),
+				_row_lengths[r]);
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_SORTEDTRANSITIONS_H_
+#define SRC_SORTEDTRANSITIONS_H_
+
+#include <cstdint>
+
+#include <ostream>
+#include <vector>
+
+/**
+ * Next symbols of each context sorted by descending probability,
+ * so generators can enumerate candidates without sorting at load time
+ */
+class SortedTransitions
+{
+public:
+	/**
+	 * @param cutoff Keep symbols until their cumulative probability reaches cutoff
+	 * @param top Keep at most top symbols of each context
+	 */
+	SortedTransitions(double cutoff, unsigned top);
+
+	/**
+	 * Sort rows of (already adjusted) frequencies, rows are split among
+	 * all available hardware threads
+	 * @param table Rows of ASCII_CHARSET_SIZE frequencies
+	 * @param cnt_rows Number of rows
+	 */
+	void Build(const uint64_t *table, unsigned cnt_rows);
+
+	/**
+	 * Length of the section in bytes
+	 */
+	uint32_t Length() const;
+
+	/**
+	 * Write rows, each as number of symbols (16 bit, big endian) followed
+	 * by the symbols in descending order of probability
+	 */
+	void Write(std::ostream &output) const;
+
+private:
+	void sortRows(const uint64_t *table, unsigned first, unsigned last);
+
+	double _cutoff;
+	unsigned _top;
+	std::vector<uint16_t> _row_lengths;
+	std::vector<uint8_t> _symbols;
+};
+
+#endif /* SRC_SORTEDTRANSITIONS_H_ */
@@ -30,32 +30,270 @@
 #include <arpa/inet.h>     // ntohl, ntohs
 #endif
 
+#include <algorithm>		// max
+#include <condition_variable>
+#include <cstring>			// memcpy
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
 
+#include "dictionaryreader.h"
 #include "markovstatistics.h"
 #include "layeredmarkovstatistics.h"
+#include "lengthmarkovstatistics.h"
 
 using namespace std;
 
 namespace {
 
 const unsigned BUFFER_SIZE = 65536;
+const size_t BATCH_SIZE = 1024 * 1024;
+
+/**
+ * Bounded queue of batches of complete lines, buffers of counted batches
+ * are returned for reuse
+ */
+class BatchQueue
+{
+public:
+	BatchQueue(size_t cnt_max) :
+			_cnt_max { cnt_max }
+	{
+	}
+
+	/**
+	 * Wait for space in queue and push batch
+	 * @return False if the queue was closed
+	 */
+	bool Push(vector<char> &&batch)
+	{
+		unique_lock<mutex> lock { _mutex };
+		_space_cv.wait(lock, [this] { return (_closed or _batches.size() < _cnt_max); });
+
+		if (_closed)
+			return (false);
+
+		_batches.push_back(move(batch));
+		_batch_cv.notify_one();
+
+		return (true);
+	}
+
+	/**
+	 * Wait for batch
+	 * @return False if the queue was closed and all batches were taken
+	 */
+	bool Pop(vector<char> &batch)
+	{
+		unique_lock<mutex> lock { _mutex };
+		_batch_cv.wait(lock, [this] { return (_closed or not _batches.empty()); });
+
+		if (_batches.empty())
+			return (false);
+
+		batch = move(_batches.front());
+		_batches.pop_front();
+		_space_cv.notify_one();
+
+		return (true);
+	}
+
+	void Close()
+	{
+		lock_guard<mutex> lock { _mutex };
+		_closed = true;
+		_batch_cv.notify_all();
+		_space_cv.notify_all();
+	}
+
+	vector<char> Take()
+	{
+		lock_guard<mutex> lock { _mutex };
+		vector<char> buffer;
+
+		if (not _buffers.empty())
+		{
+			buffer = move(_buffers.back());
+			_buffers.pop_back();
+		}
+
+		return (buffer);
+	}
+
+	void Release(vector<char> &&buffer)
+	{
+		lock_guard<mutex> lock { _mutex };
+		_buffers.push_back(move(buffer));
+	}
+
+private:
+	const size_t _cnt_max;
+	mutex _mutex;
+	condition_variable _batch_cv;
+	condition_variable _space_cv;
+	deque<vector<char>> _batches;
+	vector<vector<char>> _buffers;
+	bool _closed = false;
+};
+
+unsigned countingThreads(unsigned cnt_threads)
+{
+	if (cnt_threads == 0)
+		cnt_threads = thread::hardware_concurrency();
+
+	return (max(cnt_threads, 1u));
+}
+
+/**
+ * Count dictionary into statistics. Batches of complete lines are counted
+ * by threads into their own copies of the parallel statistics, which are
+ * merged at the end. Statistics depending on the order of lines are fed
+ * by the reading thread.
+ * @param dictionary Path to dictionary
+ * @param format Format of dictionary
+ * @param cnt_threads Number of counting threads
+ * @param parallel Statistics which may be counted in parallel
+ * @param sequential Statistics fed in order, may be nullptr
+ */
+void countDictionary(const string &dictionary, InputFormat format,
+		unsigned cnt_threads, Statistics &parallel, Statistics *sequential)
+{
+	ifstream input { dictionary, ifstream::in | ifstream::binary };
+
+	BatchQueue queue { 2 * cnt_threads };
+	vector<unique_ptr<Statistics>> counts(cnt_threads);
+	vector<exception_ptr> errors(cnt_threads);
+	vector<thread> threads;
+
+	auto worker = [&](unsigned w)
+	{
+		try
+		{
+			// Tables are allocated (and touched) by the thread counting them
+			counts[w].reset(parallel.Clone());
+			counts[w]->Subtract(parallel);
+
+			DictionaryReader reader { format };
+			vector<char> batch;
+
+			while (queue.Pop(batch))
+			{
+				reader.Feed(batch.data(), batch.size(), *counts[w]);
+				reader.Flush(*counts[w]);
+				queue.Release(move(batch));
+			}
+		}
+		catch (...)
+		{
+			errors[w] = current_exception();
+			queue.Close();
+		}
+	};
+
+	for (unsigned w = 0; w < cnt_threads; w++)
+		threads.emplace_back(worker, w);
+
+	try
+	{
+		DictionaryReader splitter { format };
+		DictionaryReader reader { format };
+		vector<char> carry;
+
+		while (input)
+		{
+			vector<char> batch = queue.Take();
+			batch.resize(carry.size() + BATCH_SIZE);
+
+			if (not carry.empty())
+				memcpy(batch.data(), carry.data(), carry.size());
+
+			input.read(batch.data() + carry.size(), BATCH_SIZE);
+			size_t length = input.gcount();
+
+			if (sequential != nullptr)
+				reader.Feed(batch.data() + carry.size(), length, *sequential);
+
+			batch.resize(carry.size() + length);
+
+			// Part of the last line is kept for the next batch
+			size_t complete = batch.size();
+			if (input)
+				complete = splitter.CompleteLength(batch.data(), batch.size());
+
+			carry.assign(batch.begin() + complete, batch.end());
+			batch.resize(complete);
+
+			// Line without end is truncated by the reader anyway
+			if (carry.size() > BATCH_SIZE)
+				carry.resize(BATCH_SIZE);
+
+			if (not batch.empty() and not queue.Push(move(batch)))
+				break;
+		}
+
+		if (sequential != nullptr)
+			reader.Flush(*sequential);
+	}
+	catch (...)
+	{
+		queue.Close();
+
+		for (auto &t : threads)
+			t.join();
+
+		throw;
+	}
+
+	queue.Close();
+
+	for (auto &t : threads)
+		t.join();
+
+	for (auto &error : errors)
+	{
+		if (error)
+			rethrow_exception(error);
+	}
+
+	for (auto &statistics : counts)
+		parallel.Merge(*statistics);
+}
 
 } // namespace
 
+void WriteFileHeader(std::ostream& output, const std::string& encoding,
+		const std::string& description)
+{
+	output << "%WSTAT-1.0%" << "\n" << "\\Encoding: " << encoding << "\n"
+			<< "\\Description: " << description << "\n" << "\3"; // end of text
+}
+
 void StatisticsGroup::Add(const std::string& name)
 {
 	if (name == "markov-classic")
-		_statistics.push_back(new MarkovStatistics);
+		Add(new MarkovStatistics);
 
 	if (name == "layered-markov")
-		_statistics.push_back(new LayeredMarkovStatistics);
+		Add(new LayeredMarkovStatistics);
+
+	if (name == "length-markov")
+		Add(new LengthMarkovStatistics);
 }
 
 StatisticsGroup::StatisticsGroup()
 {
 }
 
+StatisticsGroup::StatisticsGroup(const StatisticsGroup& other) :
+		Statistics(other)
+{
+	for (auto i : other._statistics)
+		_statistics.push_back(i->Clone());
+}
+
 StatisticsGroup::~StatisticsGroup()
 {
 	for (auto i : _statistics)
@@ -66,6 +304,11 @@ StatisticsGroup::~StatisticsGroup()
 
 void StatisticsGroup::Add(Statistics* statistic)
 {
+	// Apply settings of the group
+	statistic->SetQuantization(_quantization);
+	if (_sorted_transitions)
+		statistic->SetSortedTransitions(_sorted_cutoff, _sorted_top);
+
 	_statistics.push_back(statistic);
 }
 
@@ -77,24 +320,191 @@ Statistics::Statistics()
 {
 }
 
-void StatisticsGroup::CreateStatistics(const std::string & dictionary)
+void Statistics::CreateStatistics(const std::string & dictionary)
+{
+	unsigned cnt_threads = countingThreads(_cnt_threads);
+
+	if (cnt_threads > 1 and ParallelCounting())
+	{
+		countDictionary(dictionary, _input_format, cnt_threads, *this, nullptr);
+		return;
+	}
+
+	ifstream input { dictionary, ifstream::in | ifstream::binary };
+
+	DictionaryReader reader { _input_format };
+	vector<char> buffer(BUFFER_SIZE);
+
+	while (input)
+	{
+		input.read(buffer.data(), BUFFER_SIZE);
+		reader.Feed(buffer.data(), input.gcount(), *this);
+	}
+
+	reader.Flush(*this);
+}
+
+void StatisticsGroup::CreateStatistics(const std::string& dictionary)
+{
+	unsigned cnt_threads = countingThreads(_cnt_threads);
+
+	// Temporary groups only borrow the statistics
+	StatisticsGroup parallel;
+	StatisticsGroup sequential;
+
+	for (auto i : _statistics)
+	{
+		if (i->ParallelCounting())
+			parallel._statistics.push_back(i);
+		else
+			sequential._statistics.push_back(i);
+	}
+
+	try
+	{
+		if (cnt_threads > 1 and not parallel._statistics.empty())
+		{
+			countDictionary(dictionary, _input_format, cnt_threads, parallel,
+					sequential._statistics.empty() ? nullptr : &sequential);
+		}
+		else
+		{
+			Statistics::CreateStatistics(dictionary);
+		}
+	}
+	catch (...)
+	{
+		parallel._statistics.clear();
+		sequential._statistics.clear();
+		throw;
+	}
+
+	parallel._statistics.clear();
+	sequential._statistics.clear();
+}
+
+bool StatisticsGroup::ParallelCounting() const
 {
 	for (auto i : _statistics)
-		i->CreateStatistics(dictionary);
+	{
+		if (not i->ParallelCounting())
+			return (false);
+	}
+
+	return (true);
+}
+
+void Statistics::Output(const std::string& output_file)
+{
+	ofstream output { output_file, ofstream::out | ofstream::app
+			| ofstream::binary };
+
+	Write(output);
 }
 
-void StatisticsGroup::Output(const std::string& output_file)
+void StatisticsGroup::AddLine(const uint8_t* line, unsigned length)
 {
 	for (auto i : _statistics)
-		i->Output(output_file);
+		i->AddLine(line, length);
+}
+
+void StatisticsGroup::Write(std::ostream& output)
+{
+	for (auto i : _statistics)
+		i->Write(output);
+}
+
+Statistics* StatisticsGroup::Clone() const
+{
+	return (new StatisticsGroup(*this));
+}
+
+void StatisticsGroup::Merge(const Statistics& other)
+{
+	auto & group = static_cast<const StatisticsGroup &>(other);
+
+	for (size_t i = 0; i < _statistics.size(); i++)
+		_statistics[i]->Merge(*group._statistics[i]);
+}
+
+void StatisticsGroup::Subtract(const Statistics& other)
+{
+	auto & group = static_cast<const StatisticsGroup &>(other);
+
+	for (size_t i = 0; i < _statistics.size(); i++)
+		_statistics[i]->Subtract(*group._statistics[i]);
 }
 
 void Statistics::Summary()
 {
 }
 
+void Statistics::SetQuantization(Quantization encoding)
+{
+	_quantization = encoding;
+}
+
+void Statistics::SetSortedTransitions(double cutoff, unsigned top)
+{
+	_sorted_transitions = true;
+	_sorted_cutoff = cutoff;
+	_sorted_top = top;
+}
+
+void Statistics::SetInputFormat(InputFormat format)
+{
+	_input_format = format;
+}
+
+void Statistics::SetThreads(unsigned cnt_threads)
+{
+	_cnt_threads = cnt_threads;
+}
+
+bool Statistics::ParallelCounting() const
+{
+	return (false);
+}
+
+void Statistics::writeSectionHeader(std::ostream& output, uint8_t type,
+		uint32_t length, bool quantized)
+{
+	const uint8_t SECTION_EXTENDED = 0x80;
+	const bool extended = quantized and _quantization != Quantization::LINEAR_16;
+
+	if (extended)
+		type |= SECTION_EXTENDED;
+
+	output.write(reinterpret_cast<const char *>(&type), 1);
+
+	length = htonl(length);
+	output.write(reinterpret_cast<char *>(&length), sizeof(uint32_t));
+
+	if (extended)
+	{
+		uint8_t encoding = static_cast<uint8_t>(_quantization);
+		output.write(reinterpret_cast<const char *>(&encoding), 1);
+	}
+}
+
 void StatisticsGroup::Summary()
 {
 	for (auto i : _statistics)
 		i->Summary();
 }
+
+void StatisticsGroup::SetQuantization(Quantization encoding)
+{
+	Statistics::SetQuantization(encoding);
+
+	for (auto i : _statistics)
+		i->SetQuantization(encoding);
+}
+
+void StatisticsGroup::SetSortedTransitions(double cutoff, unsigned top)
+{
+	Statistics::SetSortedTransitions(cutoff, top);
+
+	for (auto i : _statistics)
+		i->SetSortedTransitions(cutoff, top);
+}
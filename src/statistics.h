@@ -37,10 +37,41 @@
 #include <arpa/inet.h>     // ntohl, ntohs
 #endif
 
+#include <dictionaryreader.h>
+#include <quantization.h>
+
 const unsigned ASCII_CHARSET_SIZE = 256;
 const unsigned MIN_PASS_LENGTH = 1;
 const unsigned MAX_PASS_LENGTH = 50;
 
+/**
+ * Hash password (FNV-1a)
+ * @param password Password
+ * @param length Length of password
+ * @return Hash of password
+ */
+inline uint64_t HashPassword(const uint8_t *password, unsigned length)
+{
+	uint64_t hash = UINT64_C(14695981039346656037);
+
+	for (unsigned i = 0; i < length; i++)
+	{
+		hash ^= password[i];
+		hash *= UINT64_C(1099511628211);
+	}
+
+	return (hash);
+}
+
+/**
+ * Write header of statistics file
+ * @param output Output stream
+ * @param encoding Encoding of dictionary
+ * @param description Description of statistics
+ */
+void WriteFileHeader(std::ostream &output, const std::string &encoding,
+		const std::string &description);
+
 /**
  * Base class for statistics
  */
@@ -50,24 +81,115 @@ public:
 	virtual ~Statistics();
 
 	/**
-	 * Create statistics from words in dictionary
+	 * Create statistics from words in dictionary. Statistics which may be
+	 * counted in parallel are counted by several threads into their own
+	 * copies, which are merged at the end.
 	 * @param dictionary Dictionary with words or leaked passwords
 	 */
-	virtual void CreateStatistics(const std::string &dictionary) = 0;
+	virtual void CreateStatistics(const std::string &dictionary);
+
+	/**
+	 * Update statistics with one line of dictionary
+	 * @param line Line without line feed
+	 * @param length Length of line in bytes
+	 */
+	virtual void AddLine(const uint8_t *line, unsigned length) = 0;
 
 	/**
-	 * Write statistics to file
+	 * Append statistics to file
 	 * @param output_file Path to output file
 	 */
-	virtual void Output(const std::string & output_file) = 0;
+	void Output(const std::string & output_file);
+
+	/**
+	 * Write sections with statistics to stream. Counts of statistics
+	 * are left untouched, so it may be called repeatedly.
+	 * @param output Output stream
+	 */
+	virtual void Write(std::ostream &output) = 0;
+
+	/**
+	 * Create deep copy of statistics including its settings
+	 * @return New instance, owned by the caller
+	 */
+	virtual Statistics *Clone() const = 0;
+
+	/**
+	 * Add counts of other statistics to these
+	 * @param other Statistics of the same type (created by Clone())
+	 */
+	virtual void Merge(const Statistics &other) = 0;
+
+	/**
+	 * Remove counts of other statistics from these
+	 * @param other Statistics of the same type, counted from a subset
+	 * of lines counted by these
+	 */
+	virtual void Subtract(const Statistics &other) = 0;
 
 	/**
 	 * Print short summary of created statistics (number of lines, ...)
 	 * to standard output. It's not necessary to implement it.
 	 */
 	virtual void Summary();
+
+	/**
+	 * Set encoding of probabilities in output tables
+	 * @param encoding Encoding of probabilities
+	 */
+	virtual void SetQuantization(Quantization encoding);
+
+	/**
+	 * Write sections with sorted next symbols of each context
+	 * next to the probability tables
+	 * @param cutoff Cumulative probability after which the rows are truncated
+	 * @param top Maximum number of symbols in each row
+	 */
+	virtual void SetSortedTransitions(double cutoff, unsigned top);
+
+	/**
+	 * Set format of dictionary read by CreateStatistics()
+	 * @param format Format of dictionary
+	 */
+	void SetInputFormat(InputFormat format);
+
+	/**
+	 * Set number of threads counting in CreateStatistics()
+	 * @param cnt_threads Number of threads, 0 for number of cores
+	 */
+	void SetThreads(unsigned cnt_threads);
+
+	/**
+	 * Check whether statistics counted from disjoint parts of dictionary
+	 * and merged are equal to statistics counted in one pass
+	 * @return True if statistics may be counted in parallel
+	 */
+	virtual bool ParallelCounting() const;
 protected:
 	Statistics();
+
+	/**
+	 * Write section header: type, length of the table in bytes and encoding
+	 * of probabilities. Encodings other than linear16 set the highest bit
+	 * of the type and store the encoding in one byte after the length,
+	 * so files with the default encoding keep the original layout.
+	 * @param output Output stream
+	 * @param type Type of section
+	 * @param length Length of the table in bytes
+	 * @param quantized False for sections without probabilities
+	 */
+	void writeSectionHeader(std::ostream &output, uint8_t type, uint32_t length,
+			bool quantized = true);
+
+	Quantization _quantization = Quantization::LINEAR_16;
+	Quantizer _quantizer;
+
+	bool _sorted_transitions = false;
+	double _sorted_cutoff = 1.0;
+	unsigned _sorted_top = ASCII_CHARSET_SIZE;
+
+	InputFormat _input_format = InputFormat::PLAIN;
+	unsigned _cnt_threads = 0;
 };
 
 /**
@@ -77,10 +199,22 @@ class StatisticsGroup : public Statistics
 {
 public:
 	StatisticsGroup();
+	StatisticsGroup(const StatisticsGroup &other);
 	virtual ~StatisticsGroup();
 
-	virtual void Output(const std::string & output_file);
+	virtual void AddLine(const uint8_t *line, unsigned length);
+	virtual void Write(std::ostream &output);
+	virtual Statistics *Clone() const;
+	virtual void Merge(const Statistics &other);
+	virtual void Subtract(const Statistics &other);
+
+	/**
+	 * Count statistics which may be counted in parallel in several threads
+	 * and the others, which depend on the order of lines, in the reading
+	 * thread
+	 */
 	virtual void CreateStatistics(const std::string &dictionary);
+	virtual bool ParallelCounting() const;
 
 	/**
 	 * Create new stat intance based on name and add it into queue
@@ -95,8 +229,12 @@ public:
 	void Add(Statistics * statistic);
 
 	virtual void Summary();
+	virtual void SetQuantization(Quantization encoding);
+	virtual void SetSortedTransitions(double cutoff, unsigned top);
 
 private:
+	StatisticsGroup &operator=(const StatisticsGroup &) = delete;
+
 	std::vector<Statistics *> _statistics;
 };
 
@@ -0,0 +1,622 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <statisticsserver.h>
+
+#include <cstdlib>			// EXIT_SUCCESS, EXIT_FAILURE
+#include <cstring>			// memrchr, strerror
+
+#include <atomic>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include <dictionaryreader.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>			// rename
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const unsigned BUFFER_SIZE = 65536;
+const unsigned MAX_EVENTS = 64;
+const unsigned MAX_QUEUED_BATCHES = 64;
+const unsigned MAX_POOLED_BATCHES = 256;
+
+} // namespace
+
+StatisticsServer::StatisticsServer(const StatisticsGroup& models,
+		const std::string& encoding, const std::string& description) :
+		_models(models), _encoding { encoding }, _description { description }
+{
+}
+
+void StatisticsServer::SetInputFormat(InputFormat format)
+{
+	_input_format = format;
+}
+
+StatisticsServer::~StatisticsServer()
+{
+}
+
+#ifdef __linux__
+
+int StatisticsServer::Run(const std::string& socket_path,
+		const std::string& output_file, unsigned interval, unsigned cnt_workers)
+{
+	_output_file = output_file;
+
+	// Signals are handled by the epoll loop, block them in all threads
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+	int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	sockaddr_un address { };
+	address.sun_family = AF_UNIX;
+
+	if (socket_path.size() >= sizeof(address.sun_path))
+	{
+		cerr << "Socket path is too long: " << socket_path << endl;
+		return (EXIT_FAILURE);
+	}
+
+	strcpy(address.sun_path, socket_path.c_str());
+
+	// Only socket left by previous server is removed
+	struct stat status;
+
+	if (lstat(socket_path.c_str(), &status) == 0)
+	{
+		if (not S_ISSOCK(status.st_mode))
+		{
+			cerr << "Not a socket: " << socket_path << endl;
+			return (EXIT_FAILURE);
+		}
+
+		if (unlink(socket_path.c_str()) < 0)
+		{
+			cerr << "Cannot remove " << socket_path << ": " << strerror(errno) << endl;
+			return (EXIT_FAILURE);
+		}
+	}
+	else if (errno != ENOENT)
+	{
+		cerr << "Cannot access " << socket_path << ": " << strerror(errno) << endl;
+		return (EXIT_FAILURE);
+	}
+
+	if (signal_fd < 0 or _listen_fd < 0
+			or bind(_listen_fd, reinterpret_cast<sockaddr *>(&address),
+					sizeof(address)) < 0 or listen(_listen_fd, SOMAXCONN) < 0)
+	{
+		cerr << "Cannot listen on " << socket_path << ": " << strerror(errno) << endl;
+		return (EXIT_FAILURE);
+	}
+
+	int timer_fd = -1;
+
+	if (interval > 0)
+	{
+		timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+		itimerspec period { };
+		period.it_interval.tv_sec = interval;
+		period.it_value.tv_sec = interval;
+		timerfd_settime(timer_fd, 0, &period, nullptr);
+	}
+
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	for (int fd : { _listen_fd, signal_fd, timer_fd })
+	{
+		if (fd < 0)
+			continue;
+
+		epoll_event event { };
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+	}
+
+	if (cnt_workers == 0)
+		cnt_workers = max(1u, thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < cnt_workers; i++)
+	{
+		_workers.emplace_back(new Worker);
+		_workers.back()->thread = thread { &StatisticsServer::work, this,
+				_workers.back().get() };
+	}
+
+	_publisher = thread { &StatisticsServer::publishLoop, this };
+
+	cout << "Listening on " << socket_path << " with " << cnt_workers
+			<< " workers" << endl;
+
+	bool running = true;
+	epoll_event events[MAX_EVENTS];
+
+	while (running)
+	{
+		int cnt_events = epoll_wait(_epoll_fd, events, MAX_EVENTS, -1);
+
+		if (cnt_events < 0 and errno == EINTR)
+			continue;
+
+		for (int i = 0; i < cnt_events; i++)
+		{
+			int fd = events[i].data.fd;
+
+			if (fd == _listen_fd)
+			{
+				acceptConnections();
+			}
+			else if (fd == signal_fd)
+			{
+				signalfd_siginfo info;
+
+				while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+				{
+					if (info.ssi_signo == SIGUSR1)
+						requestPublish();
+					else
+						running = false;
+				}
+			}
+			else if (fd == timer_fd)
+			{
+				uint64_t expirations;
+
+				if (read(timer_fd, &expirations, sizeof(expirations)) > 0)
+					requestPublish();
+			}
+			else if (not readConnection(fd))
+			{
+				closeConnection(fd);
+			}
+		}
+	}
+
+	// Count lines of all connections before the final snapshot
+	while (not _connections.empty())
+		closeConnection(_connections.begin()->first);
+
+	for (auto & worker : _workers)
+	{
+		lock_guard<mutex> lock { worker->queue_mutex };
+		worker->stop = true;
+		worker->queue_cv.notify_all();
+	}
+
+	for (auto & worker : _workers)
+		worker->thread.join();
+
+	{
+		lock_guard<mutex> lock { _publish_mutex };
+		_publisher_stop = true;
+		_publish_cv.notify_all();
+	}
+
+	_publisher.join();
+	publish();
+
+	close(_epoll_fd);
+	close(_listen_fd);
+	close(signal_fd);
+	if (timer_fd >= 0)
+		close(timer_fd);
+	unlink(socket_path.c_str());
+
+	return (EXIT_SUCCESS);
+}
+
+void StatisticsServer::acceptConnections()
+{
+	int fd;
+
+	while ((fd = accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC))
+			>= 0)
+	{
+		epoll_event event { };
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+		_connections[fd].reserve(BUFFER_SIZE);
+	}
+}
+
+bool StatisticsServer::readConnection(int fd)
+{
+	char buffer[BUFFER_SIZE];
+	ssize_t length = read(fd, buffer, BUFFER_SIZE);
+
+	if (length < 0)
+		return (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR);
+
+	if (length == 0)
+		return (false);
+
+	const char *data = buffer;
+	auto & partial = _connections[fd];
+	auto newline = static_cast<const char *>(memrchr(data, '\n', length));
+
+	if (newline == nullptr)
+	{
+		// Lines longer than the buffer are invalid anyway, keep only their start
+		size_t cnt_copy = min<size_t>(length, BUFFER_SIZE - min<size_t>(partial.size(),
+				BUFFER_SIZE));
+		partial.insert(partial.end(), data, data + cnt_copy);
+		return (true);
+	}
+
+	// Batches contain only complete lines, so any worker may count them
+	vector<char> batch = takeBatch();
+	batch.insert(batch.end(), partial.begin(), partial.end());
+	batch.insert(batch.end(), data, newline + 1);
+
+	partial.assign(newline + 1, data + length);
+
+	dispatch(batch);
+
+	return (true);
+}
+
+void StatisticsServer::closeConnection(int fd)
+{
+	auto & partial = _connections[fd];
+
+	if (not partial.empty())
+	{
+		vector<char> batch = takeBatch();
+		batch.insert(batch.end(), partial.begin(), partial.end());
+		batch.push_back('\n');
+
+		dispatch(batch);
+	}
+
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+	close(fd);
+
+	_connections.erase(fd);
+}
+
+void StatisticsServer::dispatch(std::vector<char>& batch)
+{
+	while (true)
+	{
+		uint64_t cnt_taken;
+		{
+			lock_guard<mutex> lock { _space_mutex };
+			cnt_taken = _cnt_taken_batches;
+		}
+
+		// Least loaded worker, ties are spread by the starting worker
+		Worker *worker = nullptr;
+		size_t least = MAX_QUEUED_BATCHES;
+
+		for (size_t i = 0; i < _workers.size() and least > 0; i++)
+		{
+			Worker *candidate = _workers[(_next_worker + i) % _workers.size()].get();
+			lock_guard<mutex> lock { candidate->queue_mutex };
+
+			if (candidate->batches.size() < least)
+			{
+				least = candidate->batches.size();
+				worker = candidate;
+			}
+		}
+
+		_next_worker++;
+
+		if (worker != nullptr)
+		{
+			// Only this thread adds batches, so the queue is still not full
+			lock_guard<mutex> lock { worker->queue_mutex };
+			worker->batches.push_back(move(batch));
+			worker->queue_cv.notify_all();
+			return;
+		}
+
+		// Stop reading from sockets while all workers are behind
+		unique_lock<mutex> lock { _space_mutex };
+		_space_cv.wait(lock, [this, cnt_taken]
+		{	return (_cnt_taken_batches != cnt_taken);});
+	}
+}
+
+void StatisticsServer::work(Worker* worker)
+{
+	// Tables are copied (and first touched) by the thread which updates them
+	{
+		lock_guard<mutex> lock { worker->statistics_mutex };
+		worker->statistics.reset(_models.Clone());
+	}
+
+	DictionaryReader reader { _input_format };
+
+	while (true)
+	{
+		vector<char> batch;
+
+		{
+			unique_lock<mutex> lock { worker->queue_mutex };
+			worker->queue_cv.wait(lock, [worker]
+			{	return (worker->stop or not worker->batches.empty());});
+
+			if (worker->batches.empty())
+				break;
+
+			batch = move(worker->batches.front());
+			worker->batches.pop_front();
+		}
+
+		{
+			lock_guard<mutex> lock { _space_mutex };
+			_cnt_taken_batches++;
+		}
+		_space_cv.notify_one();
+
+		{
+			lock_guard<mutex> lock { worker->statistics_mutex };
+			reader.Feed(batch.data(), batch.size(), *worker->statistics);
+		}
+
+		returnBatch(move(batch));
+	}
+}
+
+std::vector<char> StatisticsServer::takeBatch()
+{
+	lock_guard<mutex> lock { _pool_mutex };
+
+	if (_batch_pool.empty())
+	{
+		vector<char> batch;
+		batch.reserve(2 * BUFFER_SIZE);
+		return (batch);
+	}
+
+	vector<char> batch = move(_batch_pool.back());
+	_batch_pool.pop_back();
+
+	return (batch);
+}
+
+void StatisticsServer::returnBatch(std::vector<char>&& batch)
+{
+	lock_guard<mutex> lock { _pool_mutex };
+
+	if (_batch_pool.size() < MAX_POOLED_BATCHES)
+	{
+		batch.clear();
+		_batch_pool.push_back(move(batch));
+	}
+}
+
+void StatisticsServer::requestPublish()
+{
+	lock_guard<mutex> lock { _publish_mutex };
+	_publish_requested = true;
+	_publish_cv.notify_all();
+}
+
+void StatisticsServer::publishLoop()
+{
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock { _publish_mutex };
+			_publish_cv.wait(lock, [this]
+			{	return (_publisher_stop or _publish_requested);});
+
+			if (_publisher_stop)
+				break;
+
+			_publish_requested = false;
+		}
+
+		publish();
+	}
+}
+
+void StatisticsServer::publish()
+{
+	if (not _total)
+		_total.reset(_models.Clone());
+
+	// Workers are locked only while their tables are swapped for empty
+	// ones, new counts are added to the total outside the lock
+	for (auto & worker : _workers)
+	{
+		if (not worker->spare)
+			worker->spare.reset(_models.Clone());
+
+		bool swapped = false;
+
+		{
+			lock_guard<mutex> lock { worker->statistics_mutex };
+			if (worker->statistics)
+			{
+				worker->statistics.swap(worker->spare);
+				swapped = true;
+			}
+		}
+
+		if (not swapped)
+			continue;
+
+		_total->Merge(*worker->spare);
+		worker->spare.reset(_models.Clone());
+	}
+
+	// Write to temporary file and replace the published one atomically
+	string temp_file = _output_file + ".tmp";
+
+	{
+		ofstream output { temp_file, ofstream::out | ofstream::binary };
+		WriteFileHeader(output, _encoding, _description);
+		_total->Write(output);
+
+		if (not output)
+		{
+			cerr << "Cannot write " << temp_file << endl;
+			return;
+		}
+	}
+
+	if (rename(temp_file.c_str(), _output_file.c_str()) != 0)
+	{
+		cerr << "Cannot replace " << _output_file << ": " << strerror(errno) << endl;
+		return;
+	}
+
+	cout << "Published " << _output_file << endl;
+}
+
+int ReplayDictionary(const std::string& socket_path, const std::string& dictionary,
+		unsigned cnt_connections)
+{
+	ifstream input { dictionary, ifstream::in | ifstream::binary };
+
+	if (not input)
+	{
+		cerr << "Cannot read " << dictionary << endl;
+		return (EXIT_FAILURE);
+	}
+
+	string data { istreambuf_iterator<char>(input), istreambuf_iterator<char>() };
+
+	cnt_connections = max(1u, cnt_connections);
+
+	// Split the dictionary at line boundaries, one part per connection
+	vector<size_t> bounds { 0 };
+
+	for (unsigned i = 1; i < cnt_connections; i++)
+	{
+		size_t bound = max(bounds.back(), data.size() * i / cnt_connections);
+		bound = data.find('\n', bound);
+		bounds.push_back((bound == string::npos) ? data.size() : bound + 1);
+	}
+
+	bounds.push_back(data.size());
+
+	atomic<bool> failed { false };
+	vector<thread> connections;
+	auto start = chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < cnt_connections; i++)
+	{
+		connections.emplace_back([&, i]
+		{
+			int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+			sockaddr_un address { };
+			address.sun_family = AF_UNIX;
+			strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+			if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+			{
+				failed = true;
+				close(fd);
+				return;
+			}
+
+			size_t position = bounds[i];
+
+			while (position < bounds[i + 1])
+			{
+				ssize_t sent = send(fd, &data[position], bounds[i + 1] - position,
+						MSG_NOSIGNAL);
+
+				if (sent < 0 and errno == EINTR)
+					continue;
+
+				if (sent <= 0)
+				{
+					failed = true;
+					break;
+				}
+
+				position += sent;
+			}
+
+			close(fd);
+		});
+	}
+
+	for (auto & connection : connections)
+		connection.join();
+
+	if (failed)
+	{
+		cerr << "Cannot send dictionary to " << socket_path << endl;
+		return (EXIT_FAILURE);
+	}
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	cout << "Sent " << data.size() << " bytes over " << cnt_connections
+			<< " connections in " << elapsed.count() << " s" << endl;
+
+	return (EXIT_SUCCESS);
+}
+
+#else
+
+int StatisticsServer::Run(const std::string& socket_path,
+		const std::string& output_file, unsigned interval, unsigned cnt_workers)
+{
+	cerr << "Server mode is supported only on Linux" << endl;
+	return (EXIT_FAILURE);
+}
+
+int ReplayDictionary(const std::string& socket_path, const std::string& dictionary,
+		unsigned cnt_connections)
+{
+	cerr << "Server mode is supported only on Linux" << endl;
+	return (EXIT_FAILURE);
+}
+
+#endif
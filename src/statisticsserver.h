@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_STATISTICSSERVER_H_
+#define SRC_STATISTICSSERVER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <statistics.h>
+
+/**
+ * Keep statistics resident and update them from password lines received
+ * on a Unix domain socket. Connections are served by one epoll loop,
+ * batches of complete lines are counted by workers into their own tables
+ * and a fresh .wstat file is published periodically or on SIGUSR1.
+ */
+class StatisticsServer
+{
+public:
+	/**
+	 * @param models Configured models, each worker counts into their copy
+	 * @param encoding Encoding written to the file header
+	 * @param description Description written to the file header
+	 */
+	StatisticsServer(const StatisticsGroup &models, const std::string &encoding,
+			const std::string &description);
+	~StatisticsServer();
+
+	/**
+	 * Serve until SIGINT or SIGTERM, then publish the final statistics
+	 * @param socket_path Path of Unix domain socket
+	 * @param output_file Published .wstat file, replaced atomically
+	 * @param interval Seconds between publications, 0 to publish only on SIGUSR1
+	 * @param cnt_workers Number of workers (0 for number of cores)
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int Run(const std::string &socket_path, const std::string &output_file,
+			unsigned interval, unsigned cnt_workers);
+
+	/**
+	 * Set format of received lines, binary format is not supported
+	 * because batches are split at line feeds
+	 * @param format Format of lines
+	 */
+	void SetInputFormat(InputFormat format);
+
+private:
+	struct Worker
+	{
+		std::thread thread;
+
+		std::mutex queue_mutex;
+		std::condition_variable queue_cv;
+		std::deque<std::vector<char>> batches;
+		bool stop = false;
+
+		std::mutex statistics_mutex;
+		std::unique_ptr<Statistics> statistics;
+
+		// Empty tables swapped in by publish()
+		std::unique_ptr<Statistics> spare;
+	};
+
+	void work(Worker *worker);
+	void publish();
+	void publishLoop();
+	void requestPublish();
+
+	void acceptConnections();
+	bool readConnection(int fd);
+	void closeConnection(int fd);
+	void dispatch(std::vector<char> &batch);
+
+	std::vector<char> takeBatch();
+	void returnBatch(std::vector<char> &&batch);
+
+	const StatisticsGroup &_models;
+	std::string _encoding;
+	std::string _description;
+	std::string _output_file;
+	InputFormat _input_format = InputFormat::PLAIN;
+
+	int _epoll_fd = -1;
+	int _listen_fd = -1;
+
+	// Parts of lines received from each connection
+	std::map<int, std::vector<char>> _connections;
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	unsigned _next_worker = 0;
+
+	// Batches taken by workers, dispatch waits for a change when all are full
+	std::mutex _space_mutex;
+	std::condition_variable _space_cv;
+	uint64_t _cnt_taken_batches = 0;
+
+	std::mutex _pool_mutex;
+	std::vector<std::vector<char>> _batch_pool;
+
+	// Counts of all published batches, used only by publish()
+	std::unique_ptr<Statistics> _total;
+
+	std::thread _publisher;
+	std::mutex _publish_mutex;
+	std::condition_variable _publish_cv;
+	bool _publish_requested = false;
+	bool _publisher_stop = false;
+};
+
+/**
+ * Stand-in client for StatisticsServer: send dictionary to the socket
+ * @param socket_path Path of Unix domain socket
+ * @param dictionary Dictionary to replay
+ * @param cnt_connections Number of concurrent connections, each sends
+ * continuous part of the dictionary
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ReplayDictionary(const std::string &socket_path, const std::string &dictionary,
+		unsigned cnt_connections);
+
+#endif /* SRC_STATISTICSSERVER_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <statisticsstream.h>
+
+#include <sstream>
+
+using namespace std;
+
+StatisticsStream::StatisticsStream(const std::string& encoding,
+		const std::string& description) :
+		_encoding { encoding }, _description { description }
+{
+}
+
+StatisticsGroup& StatisticsStream::Group()
+{
+	return (_statistics);
+}
+
+void StatisticsStream::SetInputFormat(InputFormat format)
+{
+	lock_guard<mutex> lock { _mutex };
+	_reader = DictionaryReader { format };
+}
+
+void StatisticsStream::Feed(const char* data, size_t length)
+{
+	lock_guard<mutex> lock { _mutex };
+
+	if (not _active)
+		_active.reset(_statistics.Clone());
+
+	_reader.Feed(data, length, *_active);
+}
+
+void StatisticsStream::Flush()
+{
+	lock_guard<mutex> lock { _mutex };
+
+	if (not _active)
+		_active.reset(_statistics.Clone());
+
+	_reader.Flush(*_active);
+}
+
+std::string StatisticsStream::Snapshot()
+{
+	lock_guard<mutex> snapshot_lock { _snapshot_mutex };
+
+	if (not _total)
+		_total.reset(_statistics.Clone());
+
+	if (not _spare)
+		_spare.reset(_statistics.Clone());
+
+	{
+		// Only pointers are swapped while Feed() waits
+		lock_guard<mutex> lock { _mutex };
+		_active.swap(_spare);
+	}
+
+	// Nothing was fed before the first swap
+	if (_spare)
+	{
+		_total->Merge(*_spare);
+		_spare.reset(_statistics.Clone());
+	}
+
+	ostringstream output { ios_base::out | ios_base::binary };
+
+	WriteFileHeader(output, _encoding, _description);
+	_total->Write(output);
+
+	return (output.str());
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_STATISTICSSTREAM_H_
+#define SRC_STATISTICSSTREAM_H_
+
+#include <cstddef>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <dictionaryreader.h>
+#include <statistics.h>
+
+/**
+ * Embeddable interface of the library: update statistics from a stream
+ * of passwords and produce .wstat files in memory at any time
+ */
+class StatisticsStream
+{
+public:
+	/**
+	 * @param encoding Encoding of passwords written to the file header
+	 * @param description Description written to the file header
+	 */
+	StatisticsStream(const std::string &encoding, const std::string &description);
+
+	/**
+	 * Get statistics to add models and change their settings,
+	 * should be called before the first Feed()
+	 */
+	StatisticsGroup &Group();
+
+	/**
+	 * Set format of fed data, should be called before the first Feed()
+	 * @param format Format of data
+	 */
+	void SetInputFormat(InputFormat format);
+
+	/**
+	 * Update statistics with a batch of lines. Lines may be split between
+	 * batches. Doesn't allocate any memory, except the first call, which
+	 * creates the tables, and the length-conditioned model, whose hash
+	 * table doubles when it fills up.
+	 * @param data Batch of lines separated by line feeds
+	 * @param length Length of batch in bytes
+	 */
+	void Feed(const char *data, size_t length);
+
+	/**
+	 * Pass the last line without line feed into statistics
+	 */
+	void Flush();
+
+	/**
+	 * Create content of .wstat file from statistics fed so far. Feed()
+	 * continues into empty tables prepared in advance, counts fed since
+	 * the previous snapshot are merged into the total without blocking it.
+	 * Top passwords are therefore merged summaries, as in the server mode.
+	 * @return Content of .wstat file
+	 */
+	std::string Snapshot();
+
+private:
+	std::string _encoding;
+	std::string _description;
+
+	// Configured models, never fed, cloned into empty tables
+	StatisticsGroup _statistics;
+
+	// Reader and tables updated by Feed()
+	std::mutex _mutex;
+	DictionaryReader _reader;
+	std::unique_ptr<Statistics> _active;
+
+	// Counts of previous snapshots and empty tables for the next swap
+	std::mutex _snapshot_mutex;
+	std::unique_ptr<Statistics> _total;
+	std::unique_ptr<Statistics> _spare;
+};
+
+#endif /* SRC_STATISTICSSTREAM_H_ */
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <tableallocator.h>
+
+#include <cstdlib>
+#include <cstring>			// memcpy, memset
+
+#include <new>				// bad_alloc
+
+#ifdef __linux__
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <malloc.h>			// _aligned_malloc
+#endif
+
+using namespace std;
+
+namespace {
+
+const size_t CACHE_LINE_SIZE = 64;
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+bool huge_pages = true;
+
+#ifdef __linux__
+
+/**
+ * Map table of multiple of huge page size, returns nullptr on failure
+ */
+void *mapTable(size_t size)
+{
+	// Reserved huge pages first, they are rarely configured
+	if (huge_pages)
+	{
+		void *table = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if (table != MAP_FAILED)
+			return (table);
+	}
+
+	// Transparent huge pages need the mapping aligned to huge page
+	char *mapping = static_cast<char *>(mmap(nullptr, size + HUGE_PAGE_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+	if (mapping == MAP_FAILED)
+		return (nullptr);
+
+	uintptr_t address = reinterpret_cast<uintptr_t>(mapping);
+	uintptr_t aligned = (address + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+	if (aligned != address)
+		munmap(mapping, aligned - address);
+
+	munmap(reinterpret_cast<char *>(aligned) + size, address + HUGE_PAGE_SIZE - aligned);
+
+	madvise(reinterpret_cast<void *>(aligned), size,
+			huge_pages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+	return (reinterpret_cast<void *>(aligned));
+}
+
+#endif
+
+size_t mappedSize(size_t size)
+{
+	return ((size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+}
+
+bool isMapped(size_t size)
+{
+#ifdef __linux__
+	return (size >= HUGE_PAGE_SIZE);
+#else
+	return (false);
+#endif
+}
+
+} // namespace
+
+void *AllocateTable(size_t size)
+{
+	void *table = nullptr;
+
+#ifdef __linux__
+	if (isMapped(size))
+	{
+		// Mapped pages are zeroed by the kernel, don't touch them here
+		table = mapTable(mappedSize(size));
+
+		if (table == nullptr)
+			throw bad_alloc();
+
+		return (table);
+	}
+#endif
+
+	size_t aligned_size = (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+
+#ifdef _WIN32
+	table = _aligned_malloc(aligned_size, CACHE_LINE_SIZE);
+#else
+	if (posix_memalign(&table, CACHE_LINE_SIZE, aligned_size) != 0)
+		table = nullptr;
+#endif
+
+	if (table == nullptr)
+		throw bad_alloc();
+
+	memset(table, 0, aligned_size);
+
+	return (table);
+}
+
+void FreeTable(void* table, size_t size)
+{
+	if (table == nullptr)
+		return;
+
+#ifdef __linux__
+	if (isMapped(size))
+	{
+		munmap(table, mappedSize(size));
+		return;
+	}
+#endif
+
+#ifdef _WIN32
+	_aligned_free(table);
+#else
+	free(table);
+#endif
+}
+
+void SetHugePages(bool enabled)
+{
+	huge_pages = enabled;
+}
+
+CountTable::CountTable(size_t size) :
+		_table { static_cast<uint64_t *>(AllocateTable(size * sizeof(uint64_t))) },
+		_size { size }
+{
+}
+
+CountTable::CountTable(const CountTable& other) :
+		CountTable(other._size)
+{
+	memcpy(_table, other._table, _size * sizeof(uint64_t));
+}
+
+CountTable::~CountTable()
+{
+	FreeTable(_table, _size * sizeof(uint64_t));
+}
+
+CountTable& CountTable::operator=(const CountTable& other)
+{
+	if (this != &other)
+	{
+		CountTable copy { other };
+		swap(copy);
+	}
+
+	return (*this);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_TABLEALLOCATOR_H_
+#define SRC_TABLEALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>			// swap
+
+/**
+ * Allocate zeroed table aligned to cache line. Tables of at least one huge
+ * page (2 MB) are mapped with huge pages when the system provides them
+ * and with regular pages otherwise. Mapped pages are zeroed by the kernel
+ * on the first touch, so they land on the NUMA node of the thread which
+ * touches them first.
+ * @param size Size of table in bytes
+ * @return Pointer to table, never nullptr (throws std::bad_alloc)
+ */
+void *AllocateTable(size_t size);
+
+/**
+ * Free table allocated by AllocateTable()
+ * @param table Pointer to table
+ * @param size Size of table in bytes, as passed to AllocateTable()
+ */
+void FreeTable(void *table, size_t size);
+
+/**
+ * Enable or disable huge pages for subsequent allocations (enabled by default).
+ * Large tables are still mapped, only with regular pages.
+ */
+void SetHugePages(bool enabled);
+
+/**
+ * Fixed size table of 64 bit counts allocated by AllocateTable()
+ */
+class CountTable
+{
+public:
+	CountTable(size_t size);
+	CountTable(const CountTable &other);
+	~CountTable();
+
+	CountTable &operator=(const CountTable &other);
+
+	uint64_t &operator[](size_t i)
+	{
+		return (_table[i]);
+	}
+
+	const uint64_t &operator[](size_t i) const
+	{
+		return (_table[i]);
+	}
+
+	uint64_t *data()
+	{
+		return (_table);
+	}
+
+	const uint64_t *data() const
+	{
+		return (_table);
+	}
+
+	size_t size() const
+	{
+		return (_size);
+	}
+
+	void swap(CountTable &other)
+	{
+		std::swap(_table, other._table);
+		std::swap(_size, other._size);
+	}
+
+private:
+	uint64_t *_table;
+	size_t _size;
+};
+
+#endif /* SRC_TABLEALLOCATOR_H_ */
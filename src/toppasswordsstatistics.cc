@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <toppasswordsstatistics.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>     // htonl
+#endif
+
+#include <cstring>			// memcmp, memcpy
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+namespace {
+
+const unsigned SUMMARY_PASSWORDS = 10;
+
+void writeUint64(std::ostream &output, uint64_t value)
+{
+	uint32_t halves[2] = { htonl(static_cast<uint32_t>(value >> 32)),
+			htonl(static_cast<uint32_t>(value)) };
+	output.write(reinterpret_cast<char *>(halves), sizeof(halves));
+}
+
+} // namespace
+
+const uint32_t TopPasswordsStatistics::NONE;
+
+TopPasswordsStatistics::TopPasswordsStatistics(unsigned cnt_passwords) :
+		_counters(max(1u, cnt_passwords))
+{
+	// A counter moving to a new bucket may leave its old bucket empty
+	// only after the new one is created, so no more than K + 1 buckets
+	// exist at once and AddLine() never allocates
+	_buckets.reserve(_counters.size() + 1);
+
+	// Keep load factor of the index at most 1/2
+	size_t index_size = 1;
+	while (index_size < 2 * _counters.size())
+		index_size *= 2;
+
+	_index.assign(index_size, NONE);
+}
+
+TopPasswordsStatistics::~TopPasswordsStatistics()
+{
+}
+
+uint32_t TopPasswordsStatistics::find(const uint8_t* password, unsigned length,
+		uint64_t hash) const
+{
+	size_t mask = _index.size() - 1;
+
+	for (size_t i = hash & mask; _index[i] != NONE; i = (i + 1) & mask)
+	{
+		const Counter &counter = _counters[_index[i]];
+
+		if (counter.hash == hash and counter.length == length
+				and memcmp(counter.password, password, length) == 0)
+			return (_index[i]);
+	}
+
+	return (NONE);
+}
+
+void TopPasswordsStatistics::insertIndex(uint32_t counter)
+{
+	size_t mask = _index.size() - 1;
+	size_t i = _counters[counter].hash & mask;
+
+	while (_index[i] != NONE)
+		i = (i + 1) & mask;
+
+	_index[i] = counter;
+}
+
+void TopPasswordsStatistics::removeIndex(uint32_t counter)
+{
+	size_t mask = _index.size() - 1;
+	size_t i = _counters[counter].hash & mask;
+
+	while (_index[i] != counter)
+		i = (i + 1) & mask;
+
+	// Shift following entries back, so no probe sequence is broken
+	for (size_t j = (i + 1) & mask; _index[j] != NONE; j = (j + 1) & mask)
+	{
+		size_t home = _counters[_index[j]].hash & mask;
+
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			_index[i] = _index[j];
+			i = j;
+		}
+	}
+
+	_index[i] = NONE;
+}
+
+void TopPasswordsStatistics::assign(uint32_t counter, const uint8_t* password,
+		unsigned length, uint64_t hash)
+{
+	_counters[counter].hash = hash;
+	_counters[counter].length = length;
+	memcpy(_counters[counter].password, password, length);
+}
+
+uint32_t TopPasswordsStatistics::newBucket(uint64_t frequency, uint32_t prev)
+{
+	uint32_t bucket;
+
+	if (_free_bucket != NONE)
+	{
+		bucket = _free_bucket;
+		_free_bucket = _buckets[bucket].next;
+	}
+	else
+	{
+		bucket = _buckets.size();
+		_buckets.push_back(Bucket());
+	}
+
+	Bucket &b = _buckets[bucket];
+	b.frequency = frequency;
+	b.first = NONE;
+	b.prev = prev;
+	b.next = (prev == NONE) ? _min_bucket : _buckets[prev].next;
+
+	if (b.next != NONE)
+		_buckets[b.next].prev = bucket;
+
+	if (prev == NONE)
+		_min_bucket = bucket;
+	else
+		_buckets[prev].next = bucket;
+
+	return (bucket);
+}
+
+void TopPasswordsStatistics::freeBucket(uint32_t bucket)
+{
+	Bucket &b = _buckets[bucket];
+
+	if (b.prev == NONE)
+		_min_bucket = b.next;
+	else
+		_buckets[b.prev].next = b.next;
+
+	if (b.next != NONE)
+		_buckets[b.next].prev = b.prev;
+
+	b.next = _free_bucket;
+	_free_bucket = bucket;
+}
+
+void TopPasswordsStatistics::attach(uint32_t counter, uint32_t bucket)
+{
+	Counter &c = _counters[counter];
+	Bucket &b = _buckets[bucket];
+
+	c.bucket = bucket;
+	c.frequency = b.frequency;
+	c.prev = NONE;
+	c.next = b.first;
+
+	if (b.first != NONE)
+		_counters[b.first].prev = counter;
+
+	b.first = counter;
+}
+
+void TopPasswordsStatistics::detach(uint32_t counter)
+{
+	Counter &c = _counters[counter];
+
+	if (c.prev == NONE)
+		_buckets[c.bucket].first = c.next;
+	else
+		_counters[c.prev].next = c.next;
+
+	if (c.next != NONE)
+		_counters[c.next].prev = c.prev;
+}
+
+void TopPasswordsStatistics::increment(uint32_t counter)
+{
+	uint32_t bucket = _counters[counter].bucket;
+	uint64_t frequency = _buckets[bucket].frequency + 1;
+	uint32_t next = _buckets[bucket].next;
+
+	detach(counter);
+
+	if (next != NONE and _buckets[next].frequency == frequency)
+		attach(counter, next);
+	else
+		attach(counter, newBucket(frequency, bucket));
+
+	if (_buckets[bucket].first == NONE)
+		freeBucket(bucket);
+}
+
+void TopPasswordsStatistics::AddLine(const uint8_t* line, unsigned length)
+{
+	_cnt_total_lines++;
+
+	if (length < MIN_PASS_LENGTH || length > MAX_PASS_LENGTH)
+		return;
+
+	_cnt_valid_lines++;
+
+	uint64_t h = HashPassword(line, length);
+	uint32_t counter = find(line, length, h);
+
+	if (counter != NONE)
+	{
+		increment(counter);
+		return;
+	}
+
+	if (_cnt_used < _counters.size())
+	{
+		// Free counter, it starts in the bucket with frequency 1
+		counter = _cnt_used++;
+		assign(counter, line, length, h);
+		_counters[counter].error = 0;
+
+		if (_min_bucket != NONE and _buckets[_min_bucket].frequency == 1)
+			attach(counter, _min_bucket);
+		else
+			attach(counter, newBucket(1, NONE));
+
+		insertIndex(counter);
+		return;
+	}
+
+	// Replace password with the minimal frequency, its frequency
+	// becomes the error of the new password
+	counter = _buckets[_min_bucket].first;
+
+	removeIndex(counter);
+	assign(counter, line, length, h);
+	_counters[counter].error = _counters[counter].frequency;
+	insertIndex(counter);
+
+	increment(counter);
+}
+
+std::vector<TopPasswordsStatistics::Entry> TopPasswordsStatistics::entries() const
+{
+	vector<Entry> entries;
+	entries.reserve(_cnt_used);
+
+	for (uint32_t i = 0; i < _cnt_used; i++)
+	{
+		const Counter &c = _counters[i];
+		entries.push_back(Entry { c.frequency, c.error,
+				string(reinterpret_cast<const char *>(c.password), c.length) });
+	}
+
+	rank(entries);
+
+	return (entries);
+}
+
+void TopPasswordsStatistics::rank(std::vector<Entry>& entries)
+{
+	sort(entries.begin(), entries.end(), [](const Entry &e1, const Entry &e2)
+	{
+		if (e1.frequency != e2.frequency)
+			return (e1.frequency > e2.frequency);
+		return (e1.password < e2.password);
+	});
+}
+
+void TopPasswordsStatistics::rebuild(const std::vector<Entry>& entries)
+{
+	_cnt_used = 0;
+	_buckets.clear();
+	_min_bucket = NONE;
+	_free_bucket = NONE;
+	fill(_index.begin(), _index.end(), NONE);
+
+	uint32_t last_bucket = NONE;
+
+	// Fill buckets from the lowest frequency
+	for (auto e = entries.rbegin(); e != entries.rend(); e++)
+	{
+		uint32_t counter = _cnt_used++;
+		auto password = reinterpret_cast<const uint8_t *>(e->password.data());
+
+		assign(counter, password, e->password.size(), HashPassword(password, e->password.size()));
+		_counters[counter].error = e->error;
+
+		if (last_bucket == NONE or _buckets[last_bucket].frequency != e->frequency)
+			last_bucket = newBucket(e->frequency, last_bucket);
+
+		attach(counter, last_bucket);
+		insertIndex(counter);
+	}
+}
+
+uint64_t TopPasswordsStatistics::minFrequency() const
+{
+	if (_cnt_used < _counters.size())
+		return (0);
+
+	return (_buckets[_min_bucket].frequency);
+}
+
+void TopPasswordsStatistics::Write(std::ostream& output)
+{
+	vector<Entry> ranked = entries();
+
+	// Number of passwords (32 bits), then each password as frequency
+	// and error (64 bits), length (8 bits) and the password itself
+	uint32_t length = sizeof(uint32_t);
+
+	for (auto & e : ranked)
+		length += 2 * sizeof(uint64_t) + 1 + e.password.size();
+
+	writeSectionHeader(output, _TYPE, length, false);
+
+	uint32_t cnt_passwords = htonl(ranked.size());
+	output.write(reinterpret_cast<char *>(&cnt_passwords), sizeof(uint32_t));
+
+	for (auto & e : ranked)
+	{
+		uint8_t password_length = e.password.size();
+
+		writeUint64(output, e.frequency);
+		writeUint64(output, e.error);
+		output.write(reinterpret_cast<char *>(&password_length), 1);
+		output.write(e.password.data(), e.password.size());
+	}
+}
+
+Statistics* TopPasswordsStatistics::Clone() const
+{
+	auto statistics = new TopPasswordsStatistics(*this);
+
+	// Copy of vector has capacity of its size only
+	statistics->_buckets.reserve(_counters.size() + 1);
+
+	return (statistics);
+}
+
+void TopPasswordsStatistics::Merge(const Statistics& other)
+{
+	auto & statistics = static_cast<const TopPasswordsStatistics &>(other);
+
+	// Passwords missing in one summary may have occurred there up to its
+	// minimal frequency, which is added to both frequency and error
+	uint64_t min_this = minFrequency();
+	uint64_t min_other = statistics.minFrequency();
+
+	map<string, Entry> merged;
+
+	for (auto & e : entries())
+		merged[e.password] = Entry { e.frequency + min_other, e.error + min_other,
+				e.password };
+
+	for (auto & e : statistics.entries())
+	{
+		auto it = merged.find(e.password);
+
+		if (it == merged.end())
+		{
+			merged[e.password] = Entry { e.frequency + min_this, e.error + min_this,
+					e.password };
+		}
+		else
+		{
+			it->second.frequency += e.frequency - min_other;
+			it->second.error += e.error - min_other;
+		}
+	}
+
+	vector<Entry> ranked;
+	for (auto & m : merged)
+		ranked.push_back(m.second);
+
+	rank(ranked);
+
+	if (ranked.size() > _counters.size())
+		ranked.resize(_counters.size());
+
+	rebuild(ranked);
+
+	_cnt_total_lines += statistics._cnt_total_lines;
+	_cnt_valid_lines += statistics._cnt_valid_lines;
+}
+
+void TopPasswordsStatistics::Subtract(const Statistics& other)
+{
+	auto & statistics = static_cast<const TopPasswordsStatistics &>(other);
+
+	// Summaries can't be subtracted exactly. Passwords tracked in other
+	// lose their guaranteed frequency there (frequency - error), the rest
+	// may have occurred there up to its minimal frequency. Both keep
+	// the result an overestimate and widen its error accordingly.
+	uint64_t min_other = statistics.minFrequency();
+
+	map<string, const Entry *> subtracted;
+	vector<Entry> others = statistics.entries();
+
+	for (auto & e : others)
+		subtracted[e.password] = &e;
+
+	vector<Entry> ranked = entries();
+
+	for (auto & e : ranked)
+	{
+		auto it = subtracted.find(e.password);
+
+		if (it == subtracted.end())
+		{
+			e.error += min_other;
+		}
+		else
+		{
+			e.frequency -= it->second->frequency - it->second->error;
+			e.error += it->second->error;
+		}
+
+		e.error = min(e.error, e.frequency);
+	}
+
+	// Passwords which occurred only in other are not tracked anymore
+	ranked.erase(remove_if(ranked.begin(), ranked.end(), [](const Entry &e)
+	{	return (e.frequency == 0);}), ranked.end());
+
+	rank(ranked);
+	rebuild(ranked);
+
+	_cnt_total_lines -= statistics._cnt_total_lines;
+	_cnt_valid_lines -= statistics._cnt_valid_lines;
+}
+
+void TopPasswordsStatistics::Summary()
+{
+	vector<Entry> ranked = entries();
+
+	cout << "Statistics for top passwords (Space-Saving)\n"
+			<< "\tTotal lines: " << _cnt_total_lines << "\n"
+			<< "\tValid lines: " << _cnt_valid_lines << "\n"
+			<< "\tTracked passwords: " << ranked.size() << " of " << _counters.size()
+			<< "\n";
+
+	for (size_t i = 0; i < min<size_t>(ranked.size(), SUMMARY_PASSWORDS); i++)
+	{
+		cout << "\t\t" << ranked[i].password << "\t" << ranked[i].frequency;
+		if (ranked[i].error != 0)
+			cout << " (overestimated by at most " << ranked[i].error << ")";
+		cout << "\n";
+	}
+}
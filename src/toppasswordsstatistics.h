@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016 Peter Gazdik
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef SRC_TOPPASSWORDSSTATISTICS_H_
+#define SRC_TOPPASSWORDSSTATISTICS_H_
+
+#include <statistics.h>
+
+/**
+ * Track the most frequent passwords in fixed memory with the Space-Saving
+ * algorithm. Counters are kept in a stream-summary (list of buckets with
+ * equal counts, ascending) and found by an open addressing hash index,
+ * so each line costs O(1). Every reported count overestimates the real
+ * one by at most its error.
+ */
+class TopPasswordsStatistics : public Statistics
+{
+public:
+	/**
+	 * @param cnt_passwords Number of tracked passwords (K)
+	 */
+	TopPasswordsStatistics(unsigned cnt_passwords);
+	virtual ~TopPasswordsStatistics();
+
+	virtual void AddLine(const uint8_t *line, unsigned length);
+	virtual void Write(std::ostream &output);
+	virtual Statistics *Clone() const;
+	virtual void Merge(const Statistics &other);
+	virtual void Subtract(const Statistics &other);
+	virtual void Summary();
+
+private:
+	static const uint32_t NONE = UINT32_MAX;
+
+	struct Counter
+	{
+		uint64_t frequency;
+		uint64_t error;
+		uint64_t hash;
+		uint32_t bucket;
+		uint32_t prev;
+		uint32_t next;
+		uint8_t length;
+		uint8_t password[MAX_PASS_LENGTH];
+	};
+
+	struct Bucket
+	{
+		uint64_t frequency;
+		uint32_t first;
+		uint32_t prev;
+		uint32_t next;
+	};
+
+	struct Entry
+	{
+		uint64_t frequency;
+		uint64_t error;
+		std::string password;
+	};
+
+	const uint8_t _TYPE = 6;
+
+	/**
+	 * Find counter of password
+	 * @return Index of counter or NONE
+	 */
+	uint32_t find(const uint8_t *password, unsigned length, uint64_t hash) const;
+	void insertIndex(uint32_t counter);
+	void removeIndex(uint32_t counter);
+
+	/**
+	 * Set password of counter
+	 */
+	void assign(uint32_t counter, const uint8_t *password, unsigned length,
+			uint64_t hash);
+
+	/**
+	 * Create bucket after bucket prev (NONE for the head of the list)
+	 */
+	uint32_t newBucket(uint64_t frequency, uint32_t prev);
+	void freeBucket(uint32_t bucket);
+	void attach(uint32_t counter, uint32_t bucket);
+	void detach(uint32_t counter);
+	void increment(uint32_t counter);
+
+	/**
+	 * Get tracked passwords sorted by descending frequency
+	 */
+	std::vector<Entry> entries() const;
+
+	/**
+	 * Sort entries by descending frequency
+	 */
+	static void rank(std::vector<Entry> &entries);
+
+	/**
+	 * Replace content of summary by entries sorted by descending frequency
+	 */
+	void rebuild(const std::vector<Entry> &entries);
+
+	/**
+	 * Minimal tracked frequency when all counters are used, 0 otherwise
+	 */
+	uint64_t minFrequency() const;
+
+	std::vector<Counter> _counters;
+	std::vector<Bucket> _buckets;
+	std::vector<uint32_t> _index;
+	uint32_t _cnt_used = 0;
+	uint32_t _min_bucket = NONE;
+	uint32_t _free_bucket = NONE;
+
+	uint64_t _cnt_valid_lines = 0;
+	uint64_t _cnt_total_lines = 0;
+};
+
+#endif /* SRC_TOPPASSWORDSSTATISTICS_H_ */
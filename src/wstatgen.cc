@@ -22,6 +22,8 @@
  */
 
 #include <getopt.h>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 
 #include <iostream>
@@ -29,11 +31,17 @@
 #include <string>
 #include <vector>
 
+#include <kfoldstatistics.h>
 #include <statistics.h>
+#include <statisticsserver.h>
+#include <tableallocator.h>
+#include <toppasswordsstatistics.h>
 
 using namespace std;
 
-const string help_msg = "wstatgen [OPTIONS]\n\n"
+const string help_msg = "wstatgen [OPTIONS]\n"
+		"wstatgen serve -s SOCKET -o OUTPUT -e ENCODING [OPTIONS]\n"
+		"wstatgen replay -s SOCKET -f FILE [-j CONNECTIONS]\n\n"
 		"Information:\n"
 		"\t-h, --help\t\tprints this help\n"
 		"\t-l, --list\t\tlist all known charachter sets\n\n"
@@ -42,9 +50,46 @@ const string help_msg = "wstatgen [OPTIONS]\n\n"
 		"\t-o, --output\t\toutput file\n"
 		"\t-e, --encoding\t\tencoding of input file\n"
 		"\t-d, --description\tdescription of output file\n"
+		"\t-t, --input-format\tformat of input file: plain (default), hex\n"
+		"\t\t\t\t(decodes $HEX[...]), potfile (hash:password,\n"
+		"\t\t\t\tdecodes $HEX[...]) or binary (16-bit big endian\n"
+		"\t\t\t\tlength before each password)\n"
+		"\t-q, --quantization\tencoding of probabilities: linear16 (default),\n"
+		"\t\t\t\tlog16 or log8\n"
+		"\t--sorted-transitions\twrite next symbols of each context sorted\n"
+		"\t\t\t\tby descending probability\n"
+		"\t--sorted-cutoff P\ttruncate sorted rows at cumulative probability P\n"
+		"\t--sorted-top N\t\tkeep at most N symbols in sorted rows\n"
+		"\t--kfold K\t\talso write K models for cross-validation, each\n"
+		"\t\t\t\tleaving out one fold of lines assigned by hash\n"
+		"\t\t\t\tof line and its number (2-100)\n"
+		"\t--no-huge-pages\tallocate tables without huge pages\n"
 		"\t--markov-classic\tstatistic for Classic Markov model\n"
 		"\t--layered-markov\tstatistic for Layered Markov model\n"
-		"\t--context-markov\tstatistic for Variable-order Markov model\n";
+		"\t--length-markov\tstatistic for Layered Markov model conditioned\n"
+		"\t\t\t\ton password length\n"
+		"\t--top-passwords K\tK most frequent passwords (Space-Saving)\n"
+		"\t--context-markov\tstatistic for Variable-order Markov model\n\n"
+		"Server mode (serve, replay):\n"
+		"\t-s, --socket\t\tUnix domain socket receiving password lines\n"
+		"\t-i, --interval\t\tseconds between publications of output file,\n"
+		"\t\t\t\t0 to publish only on SIGUSR1 (default 10)\n"
+		"\t-j, --threads\t\tnumber of counting threads, server workers or\n"
+		"\t\t\t\treplayed connections (default: number of cores)\n";
+
+const unsigned MAX_THREADS = 1024;
+const unsigned MAX_FOLDS = 100;
+const unsigned MAX_TOP_PASSWORDS = 10000000;
+
+enum LongOptions
+{
+	OPT_SORTED_TRANSITIONS = 256,
+	OPT_SORTED_CUTOFF,
+	OPT_SORTED_TOP,
+	OPT_NO_HUGE_PAGES,
+	OPT_TOP_PASSWORDS,
+	OPT_KFOLD
+};
 
 struct Options
 {
@@ -54,8 +99,19 @@ struct Options
 	string output_file;
 	string encoding;
 	string description;
+	InputFormat input_format = InputFormat::PLAIN;
+	Quantization quantization = Quantization::LINEAR_16;
+	bool sorted_transitions = false;
+	double sorted_cutoff = 1.0;
+	unsigned sorted_top = ASCII_CHARSET_SIZE;
 //	StatisticGroup statistics;
 	int statistic_flag = false;
+	vector<string> statistics;
+	unsigned top_passwords = 0;
+	unsigned kfold = 0;
+	string socket_path;
+	unsigned interval = 10;
+	unsigned threads = 0;
 };
 
 Options options;
@@ -67,21 +123,87 @@ struct option long_options[] = {
 			{ "output", required_argument, 0, 'o' },
 			{ "encoding", required_argument, 0, 'e' },
 			{ "description", required_argument, 0, 'd' },
+			{ "quantization", required_argument, 0, 'q' },
+			{ "input-format", required_argument, 0, 't' },
+			{ "socket", required_argument, 0, 's' },
+			{ "interval", required_argument, 0, 'i' },
+			{ "threads", required_argument, 0, 'j' },
+			{ "sorted-transitions", no_argument, 0, OPT_SORTED_TRANSITIONS },
+			{ "sorted-cutoff", required_argument, 0, OPT_SORTED_CUTOFF },
+			{ "sorted-top", required_argument, 0, OPT_SORTED_TOP },
+			{ "no-huge-pages", no_argument, 0, OPT_NO_HUGE_PAGES },
+			{ "top-passwords", required_argument, 0, OPT_TOP_PASSWORDS },
+			{ "kfold", required_argument, 0, OPT_KFOLD },
 			{ "markov-classic", no_argument, &options.statistic_flag, true },
 			{ "layered-markov", no_argument, &options.statistic_flag, true },
+			{ "length-markov", no_argument, &options.statistic_flag, true },
 			{ "context-markov", no_argument, &options.statistic_flag, true },
 			{ 0, 0, 0, 0 } };
 
+/**
+ * Parse whole text as unsigned number in range
+ * @return False if text isn't a number in range
+ */
+bool parseUnsigned(const char *text, unsigned min, unsigned max, unsigned &value)
+{
+	char *end;
+	errno = 0;
+	long long number = strtoll(text, &end, 10);
+
+	if (errno != 0 or end == text or *end != '\0' or number < min
+			or number > max)
+		return (false);
+
+	value = static_cast<unsigned>(number);
+	return (true);
+}
+
+/**
+ * Parse whole text as number in range (min, max]
+ * @return False if text isn't a number in range
+ */
+bool parseDouble(const char *text, double min, double max, double &value)
+{
+	char *end;
+	errno = 0;
+	double number = strtod(text, &end);
+
+	if (errno != 0 or end == text or *end != '\0'
+			or not (number > min and number <= max))
+		return (false);
+
+	value = number;
+	return (true);
+}
+
+/**
+ * Exit with message about invalid value of option
+ */
+void invalidValue(const char *option, const char *text)
+{
+	cerr << "Invalid value of " << option << ": " << text << endl;
+	exit(EXIT_FAILURE);
+}
+
 int main(int argc, char *argv[])
 {
 	int c;
 	int option_index = 0;
 
 	StatisticsGroup statistics;
+	string mode;
+
+	// Optional command before options
+	if (argc > 1 and argv[1][0] != '-')
+	{
+		mode = argv[1];
+		argc--;
+		argv++;
+	}
 
 	while (1)
 	{
-		c = getopt_long(argc, argv, "hlf:o:e:d:", long_options, &option_index);
+		c = getopt_long(argc, argv, "hlf:o:e:d:q:t:s:i:j:", long_options, &option_index);
 
 		if (c == -1)
 			break;
@@ -89,7 +211,7 @@ int main(int argc, char *argv[])
 		switch (c)
 		{
 			case 0:
-				statistics.Add(long_options[option_index].name);
+				options.statistics.push_back(long_options[option_index].name);
 				break;
 			case 'h':
 				options.help = true;
@@ -109,6 +231,56 @@ int main(int argc, char *argv[])
 			case 'd':
 				options.description = optarg;
 				break;
+			case 'q':
+				if (not ParseQuantization(optarg, options.quantization))
+				{
+					cerr << "Unknown quantization: " << optarg << endl;
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 't':
+				if (not ParseInputFormat(optarg, options.input_format))
+				{
+					cerr << "Unknown input format: " << optarg << endl;
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 's':
+				options.socket_path = optarg;
+				break;
+			case 'i':
+				if (not parseUnsigned(optarg, 0, INT_MAX, options.interval))
+					invalidValue("--interval", optarg);
+				break;
+			case 'j':
+				if (not parseUnsigned(optarg, 0, MAX_THREADS, options.threads))
+					invalidValue("--threads", optarg);
+				break;
+			case OPT_SORTED_TRANSITIONS:
+				options.sorted_transitions = true;
+				break;
+			case OPT_SORTED_CUTOFF:
+				options.sorted_transitions = true;
+				if (not parseDouble(optarg, 0.0, 1.0, options.sorted_cutoff))
+					invalidValue("--sorted-cutoff", optarg);
+				break;
+			case OPT_SORTED_TOP:
+				options.sorted_transitions = true;
+				if (not parseUnsigned(optarg, 1, ASCII_CHARSET_SIZE, options.sorted_top))
+					invalidValue("--sorted-top", optarg);
+				break;
+			case OPT_TOP_PASSWORDS:
+				if (not parseUnsigned(optarg, 1, MAX_TOP_PASSWORDS, options.top_passwords))
+					invalidValue("--top-passwords", optarg);
+				options.statistic_flag = true;
+				break;
+			case OPT_KFOLD:
+				if (not parseUnsigned(optarg, 2, MAX_FOLDS, options.kfold))
+					invalidValue("--kfold", optarg);
+				break;
+			case OPT_NO_HUGE_PAGES:
+				SetHugePages(false);
+				break;
 			default:
 				cerr << "Missing options" << endl;
 				exit(EXIT_FAILURE);
@@ -128,19 +300,84 @@ int main(int argc, char *argv[])
 		exit(EXIT_SUCCESS);
 	}
 
-	if (options.input_file.empty() or options.output_file.empty()
-			or options.encoding.empty() or not options.statistic_flag)
+	if (mode == "replay")
+	{
+		if (options.socket_path.empty() or options.input_file.empty())
+		{
+			cout << "Missing options" << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		return (ReplayDictionary(options.socket_path, options.input_file,
+				options.threads));
+	}
+
+	if (not mode.empty() and mode != "serve")
+	{
+		cerr << "Unknown command: " << mode << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if ((mode.empty() and options.input_file.empty())
+			or (not mode.empty() and options.socket_path.empty())
+			or options.output_file.empty() or options.encoding.empty()
+			or not options.statistic_flag)
 	{
 		cout << "Missing options" << endl;
 		exit(EXIT_FAILURE);
 	}
 
-	// Open output file in text mode and write the header to the beginning
-	ofstream ofs { options.output_file, ofstream::out };
-	ofs << "%WSTAT-1.0%" << "\n" << "\\Encoding: " << options.encoding << "\n"
-			<< "\\Description: " << options.description << "\n" << "\3"; // end of text
+	if (options.input_format == InputFormat::BINARY and not mode.empty())
+	{
+		cerr << "Binary input format is not supported by server" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (options.kfold > 0 and not mode.empty())
+	{
+		cerr << "Cross-validation needs a dictionary" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	for (auto & name : options.statistics)
+		statistics.Add(name);
+
+	if (options.top_passwords > 0)
+		statistics.Add(new TopPasswordsStatistics(options.top_passwords));
+
+	statistics.SetQuantization(options.quantization);
+	if (options.sorted_transitions)
+		statistics.SetSortedTransitions(options.sorted_cutoff, options.sorted_top);
+
+	if (mode == "serve")
+	{
+		StatisticsServer server { statistics, options.encoding, options.description };
+		server.SetInputFormat(options.input_format);
+		return (server.Run(options.socket_path, options.output_file, options.interval,
+				options.threads));
+	}
+
+	// Open output file and write the header to the beginning
+	ofstream ofs { options.output_file, ofstream::out | ofstream::binary };
+	WriteFileHeader(ofs, options.encoding, options.description);
 	ofs.close();
 
+	if (options.kfold > 1)
+	{
+		KFoldStatistics kfold { statistics, options.kfold };
+
+		kfold.SetInputFormat(options.input_format);
+		kfold.WriteHeldOut(options.output_file);
+		kfold.CreateStatistics(options.input_file);
+		kfold.Output(options.output_file);
+		kfold.OutputFolds(options.output_file, options.encoding, options.description);
+		kfold.Summary();
+
+		return (EXIT_SUCCESS);
+	}
+
+	statistics.SetInputFormat(options.input_format);
+	statistics.SetThreads(options.threads);
 	statistics.CreateStatistics(options.input_file);
 	statistics.Output(options.output_file);
 	statistics.Summary();